@@ -0,0 +1,93 @@
+// Measures the output writers of CaboCha::Tree.
+//
+// usage: writer_benchmark parsed-file [iterations]
+//
+// parsed-file is an output of "cabocha -f1" in UTF-8. Every sentence
+// is read once, and then written in the tree, lattice, XML and CoNLL
+// formats |iterations| times (default 500).
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <cabocha.h>
+
+int main(int argc, char **argv) {
+  if (argc < 2) {
+    std::cerr << "usage: " << argv[0] << " parsed-file [iterations]"
+              << std::endl;
+    return -1;
+  }
+
+  std::ifstream ifs(argv[1]);
+  if (!ifs) {
+    std::cerr << "no such file or directory: " << argv[1] << std::endl;
+    return -1;
+  }
+
+  const int iterations = argc > 2 ? std::atoi(argv[2]) : 500;
+
+  std::vector<std::string> sentences;
+  std::string line, sentence;
+  while (std::getline(ifs, line)) {
+    sentence += line;
+    sentence += '\n';
+    if (line == "EOS") {
+      sentences.push_back(sentence);
+      sentence.clear();
+    }
+  }
+
+  std::vector<CaboCha::Tree *> trees;
+  for (size_t i = 0; i < sentences.size(); ++i) {
+    CaboCha::Tree *tree = new CaboCha::Tree;
+    tree->set_charset(CaboCha::UTF8);
+    if (!tree->read(sentences[i].c_str(), sentences[i].size(),
+                    CaboCha::INPUT_DEP)) {
+      std::cerr << "cannot parse sentence: " << sentences[i] << std::endl;
+      return -1;
+    }
+    tree->set_output_layer(CaboCha::OUTPUT_DEP);
+    trees.push_back(tree);
+  }
+
+  if (trees.empty()) {
+    std::cerr << "no sentence in " << argv[1] << std::endl;
+    return -1;
+  }
+
+  const struct {
+    const char *name;
+    CaboCha::FormatType format;
+  } kFormat[] = {
+    { "tree",    CaboCha::FORMAT_TREE },
+    { "lattice", CaboCha::FORMAT_LATTICE },
+    { "xml",     CaboCha::FORMAT_XML },
+    { "conll",   CaboCha::FORMAT_CONLL }
+  };
+
+  std::cout << trees.size() << " sentences x " << iterations
+            << " iterations" << std::endl;
+  for (size_t f = 0; f < sizeof(kFormat) / sizeof(kFormat[0]); ++f) {
+    size_t bytes = 0;
+    const std::clock_t start = std::clock();
+    for (int n = 0; n < iterations; ++n) {
+      for (size_t i = 0; i < trees.size(); ++i) {
+        bytes += std::strlen(trees[i]->toString(kFormat[f].format));
+      }
+    }
+    const double elapsed =
+        static_cast<double>(std::clock() - start) / CLOCKS_PER_SEC;
+    std::cout << kFormat[f].name << ": "
+              << 1e9 * elapsed / (iterations * trees.size())
+              << " ns/sentence (" << bytes << " bytes)" << std::endl;
+  }
+
+  for (size_t i = 0; i < trees.size(); ++i) {
+    delete trees[i];
+  }
+
+  return 0;
+}
@@ -0,0 +1,7 @@
+// CaboCha -- Yet Another Japanese Dependency Parser
+#include "cabocha.h"
+#include "winmain.h"
+
+int main(int argc, char**argv) {
+  return cabocha_cross_validation(argc, argv);
+}
@@ -173,6 +173,7 @@ extern "C" {
 
   CABOCHA_DLL_EXTERN int                    cabocha_learn(int argc, char **argv);
   CABOCHA_DLL_EXTERN int                    cabocha_system_eval(int argc, char **argv);
+  CABOCHA_DLL_EXTERN int                    cabocha_cross_validation(int argc, char **argv);
   CABOCHA_DLL_EXTERN int                    cabocha_model_index(int argc, char **argv);
 #endif
 
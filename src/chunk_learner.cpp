@@ -3,17 +3,29 @@
 //  $Id: chunk_learner.cpp 50 2009-05-03 08:25:36Z taku-ku $;
 //
 //  Copyright(C) 2001-2008 Taku Kudo <taku@chasen.org>
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#ifdef HAVE_MEMFD_CREATE
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
 #include <crfpp.h>
 #include <fstream>
 #include <iostream>
 #include <iterator>
+#include <sstream>
 #include <string>
 #include <vector>
 #include "cabocha.h"
 #include "chunker.h"
 #include "common.h"
+#include "corpus_reader.h"
 #include "ne.h"
 #include "scoped_ptr.h"
+#include "thread.h"
 #include "utils.h"
 #include "timer.h"
 #include "tree_allocator.h"
@@ -79,6 +91,111 @@ const char ne_crfpp_template[] =
 
 namespace CaboCha {
 namespace {
+// A temporary file handed to CRF++ by its name. With memfd_create(),
+// the file lives only in memory as /proc/self/fd/N, so that the
+// training data of gigabytes is never written to the disk.
+class TemporaryFile {
+ public:
+  void open(const std::string &filename) {
+    close();
+#ifdef HAVE_MEMFD_CREATE
+    fd_ = ::memfd_create("cabocha-learn", 0);
+    if (fd_ >= 0) {
+      std::ostringstream os;
+      os << "/proc/self/fd/" << fd_;
+      filename_ = os.str();
+      if (::access(filename_.c_str(), F_OK) == 0) {
+        return;
+      }
+      close();   // /proc is not mounted.
+    }
+#endif
+    filename_ = filename;
+  }
+
+  void close() {
+#ifdef HAVE_MEMFD_CREATE
+    if (fd_ >= 0) {
+      ::close(fd_);
+      fd_ = -1;
+      filename_.clear();
+    }
+#endif
+    if (!filename_.empty()) {
+      Unlink(filename_.c_str());
+      filename_.clear();
+    }
+  }
+
+  const char *filename() const { return filename_.c_str(); }
+
+  TemporaryFile() : fd_(-1) {}
+  virtual ~TemporaryFile() { this->close(); }
+
+ private:
+  std::string filename_;
+  int         fd_;
+};
+
+// Writes the CRF++ training data of the sentences [begin, end) of
+// the corpus to |stream| with its own analyzer.
+class FeatureExtractor : public thread {
+ public:
+  const CorpusReader  *reader;
+  size_t               begin;
+  size_t               end;
+  InputLayerType       input;
+  volatile int        *line;  // sentences processed by all threads
+  bool                 verbose;
+  scoped_ptr<Analyzer> analyzer;
+  scoped_ptr<Tree>     tree;
+
+  void open(ParserType type, CharsetType charset, PossetType posset,
+            std::ostream *stream) {
+    input = INPUT_POS;
+    if (type == TRAIN_NE) {
+      analyzer.reset(new NE);
+      input = INPUT_POS;
+    } else if (type == TRAIN_CHUNK) {
+      analyzer.reset(new Chunker);
+      input = INPUT_CHUNK;
+    } else {
+      CHECK_DIE(false) << "unknown type: " << type;
+    }
+
+    tree.reset(new Tree);
+    tree->set_charset(charset);
+    tree->set_posset(posset);
+    tree->allocator()->set_stream(stream);
+
+    analyzer->set_charset(charset);
+    analyzer->set_posset(posset);
+    analyzer->set_action_mode(TRAINING_MODE);
+  }
+
+  void run() {
+    for (size_t i = begin; i < end; ++i) {
+      CHECK_DIE(tree->read(reader->sentence(i),
+                           reader->sentence_length(i),
+                           input)) << "cannot parse sentence";
+      CHECK_DIE(analyzer->parse(tree.get())) << analyzer->what();
+      if (tree->empty()) {
+        continue;
+      }
+      const int n = atomic_add(line, 1);
+      if (verbose && n % 100 == 0) {
+        std::cout << n << ".. " << std::flush;
+      }
+    }
+    tree.reset(0);
+  }
+
+  FeatureExtractor()
+      : reader(0), begin(0), end(0), input(INPUT_POS), line(0),
+        verbose(false) {}
+};
+}  // namespace
+
 bool runChunkingTrainingWithCRFPP(
     ParserType type,
     const char *train_file,
@@ -87,67 +204,93 @@ bool runChunkingTrainingWithCRFPP(
     CharsetType charset,
     PossetType posset,
     double cost,
-    int freq) {
+    int freq,
+    size_t thread_size) {
   CHECK_DIE(freq >= 1);
   CHECK_DIE(cost > 0.0);
+  CHECK_DIE(thread_size > 0) << "thread size must be positive value";
   const char *template_str = type == TRAIN_CHUNK ?
       chunk_crfpp_template : ne_crfpp_template;
 
-  const std::string tmp_train_file = std::string(model_file) + ".crfpp";
-  const std::string templ_file = std::string(model_file) + ".templ";
+  TemporaryFile train_tmp;
+  TemporaryFile templ_tmp;
+  train_tmp.open(std::string(model_file) + ".crfpp");
+  templ_tmp.open(std::string(model_file) + ".templ");
+  const char *tmp_train_file = train_tmp.filename();
+  const char *templ_file = templ_tmp.filename();
 
   {
     progress_timer pg;
-    std::ifstream ifs(WPATH(train_file));
-    CHECK_DIE(ifs) << "no such file or directory: " << train_file;
+    CorpusReader reader;
+    CHECK_DIE(reader.open(train_file, INPUT_CHUNK)) << reader.what();
 
-    std::ofstream ofs(WPATH(tmp_train_file.c_str()));
+    std::ofstream ofs(WPATH(tmp_train_file));
     CHECK_DIE(ofs) << "permission denied: " << tmp_train_file;
 
-    scoped_ptr<Analyzer> analyzer(0);
-    Tree tree;
     std::cout << "reading training data: " << std::flush;
 
-    InputLayerType input = INPUT_POS;
-    if (type == TRAIN_NE) {
-      analyzer.reset(new NE);
-      input = INPUT_POS;
-    } else if (type == TRAIN_CHUNK) {
-      analyzer.reset(new Chunker);
-      input = INPUT_CHUNK;
-    } else {
-      CHECK_DIE(false) << "unknown type: " << type;
+    // The first shard is written to |ofs| directly, and the others
+    // to their own files, which are appended to |ofs| in order.
+    std::vector<size_t> range;
+    reader.split(thread_size, &range);
+    scoped_array<FeatureExtractor> extractor(
+        new FeatureExtractor[thread_size]);
+    scoped_array<TemporaryFile> shard_tmp(
+        thread_size > 1 ? new TemporaryFile[thread_size - 1] : 0);
+    scoped_array<std::ofstream> shard_ofs(
+        thread_size > 1 ? new std::ofstream[thread_size - 1] : 0);
+    volatile int line = 0;
+    for (size_t k = 0; k < thread_size; ++k) {
+      std::ostream *stream = &ofs;
+      if (k > 0) {
+        std::ostringstream os;
+        os << model_file << ".crfpp." << k;
+        shard_tmp[k - 1].open(os.str());
+        const char *shard_file = shard_tmp[k - 1].filename();
+        shard_ofs[k - 1].open(WPATH(shard_file));
+        CHECK_DIE(shard_ofs[k - 1]) << "permission denied: " << shard_file;
+        stream = &shard_ofs[k - 1];
+      }
+      extractor[k].reader = &reader;
+      extractor[k].begin = range[k];
+      extractor[k].end = range[k + 1];
+      extractor[k].line = &line;
+      extractor[k].verbose = (k == 0);
+      extractor[k].open(type, charset, posset, stream);
     }
 
-    tree.set_charset(charset);
-    tree.set_posset(posset);
-    tree.allocator()->set_stream(&ofs);
-
-    analyzer->set_charset(charset);
-    analyzer->set_posset(posset);
-    analyzer->set_action_mode(TRAINING_MODE);
-
-    size_t line = 0;
-    std::string str;
-    while (ifs) {
-      CHECK_DIE(read_sentence(&ifs, &str, INPUT_CHUNK));
-      CHECK_DIE(tree.read(str.c_str(), str.size(),
-                          input)) << "cannot parse sentence";
-      CHECK_DIE(analyzer->parse(&tree)) << analyzer->what();
-      if (tree.empty()) {
-        continue;
+    if (thread_size == 1) {
+      extractor[0].run();
+    } else {
+      for (size_t k = 0; k < thread_size; ++k) {
+        extractor[k].start();
       }
-      if (++line % 100 == 0) {
-        std::cout << line << ".. " << std::flush;
+      for (size_t k = 0; k < thread_size; ++k) {
+        extractor[k].join();
       }
     }
+
+    for (size_t k = 1; k < thread_size; ++k) {
+      shard_ofs[k - 1].close();
+      const char *shard_file = shard_tmp[k - 1].filename();
+      {
+        std::ifstream ifs(WPATH(shard_file));
+        CHECK_DIE(ifs) << "no such file or directory: " << shard_file;
+        if (ifs.peek() != EOF) {
+          ofs << ifs.rdbuf();
+        }
+      }
+      shard_tmp[k - 1].close();
+    }
+    CHECK_DIE(ofs) << "write() failed: " << tmp_train_file;
+
     std::cout << "\nDone! ";
   }
 
   // call CRF++
   {
     {
-      std::ofstream ofs(WPATH(templ_file.c_str()));
+      std::ofstream ofs(WPATH(templ_file));
       CHECK_DIE(ofs) << "permission denied: " << templ_file;
       ofs << template_str;
     }
@@ -162,23 +305,24 @@ bool runChunkingTrainingWithCRFPP(
     char buf2[256];
     snprintf(buf2, sizeof(buf2), "--cost=%f", cost);
     argv.push_back(buf2);
+
+    char buf3[256];
+    snprintf(buf3, sizeof(buf3), "--thread=%d",
+             static_cast<int>(thread_size));
+    argv.push_back(buf3);
     argv.push_back("-t");
 
-    argv.push_back(templ_file.c_str());
-    argv.push_back(tmp_train_file.c_str());
+    argv.push_back(templ_file);
+    argv.push_back(tmp_train_file);
     argv.push_back(model_file);
 
     CHECK_DIE(0 == crfpp_learn(static_cast<int>(argv.size()),
                                const_cast<char **>(&argv[0])))
         << "crfpp_learn execution error";
-
-    Unlink(tmp_train_file.c_str());
-    Unlink(templ_file.c_str());
   }
 
   return true;
 }
-}  // namespace
 
 bool runChunkingTraining(const char *train_file,
                          const char *model_file,
@@ -194,7 +338,7 @@ bool runChunkingTraining(const char *train_file,
                                       charset,
                                       posset,
                                       cost,
-                                      freq);
+                                      freq, 1);
 }
 
 bool runNETraining(const char *train_file,
@@ -211,6 +355,6 @@ bool runNETraining(const char *train_file,
                                       charset,
                                       posset,
                                       cost,
-                                      freq);
+                                      freq, 1);
 }
 }
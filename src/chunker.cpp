@@ -5,17 +5,20 @@
 //  Copyright(C) 2001-2008 Taku Kudo <taku@chasen.org>
 #include <crfpp.h>
 #include <cstdio>
+#include <cstring>
 #include <iterator>
 #include "cabocha.h"
 #include "chunker.h"
 #include "common.h"
+#include "crf.h"
 #include "param.h"
+#include "token_cache.h"
 #include "tree_allocator.h"
 #include "utils.h"
 
 namespace CaboCha {
 
-Chunker::Chunker(): model_(0) {}
+Chunker::Chunker(): model_(0), begin_label_(-1) {}
 Chunker::~Chunker() { close(); }
 
 bool Chunker::open(const Param &param) {
@@ -23,6 +26,18 @@ bool Chunker::open(const Param &param) {
 
   if (action_mode() == PARSING_MODE) {
     const std::string filename = param.get<std::string>("chunker-model");
+
+    // Uses the native decoder when the model is a B/I model in the
+    // binary format of CRF++. Otherwise, leaves it to CRF++.
+    crf_model_.reset(new CRFModel);
+    if (crf_model_->open(filename.c_str()) &&
+        crf_model_->ysize() == 2 && crf_model_->xsize() <= 2 &&
+        crf_model_->yid("B") >= 0) {
+      begin_label_ = crf_model_->yid("B");
+      return true;
+    }
+    crf_model_.reset(0);
+
     std::vector<const char *> argv;
     argv.push_back(param.program_name());
     argv.push_back("-m");
@@ -40,76 +55,89 @@ bool Chunker::open(const Param &param) {
 }
 
 void Chunker::close() {
+  crf_model_.reset(0);
   crfpp_model_destroy(model_);
   model_ = 0;
+  begin_label_ = -1;
 }
 
 bool Chunker::parse(Tree *tree) const {
   TreeAllocator *allocator = tree->allocator();
   CHECK_TREE_FALSE(allocator);
 
-  if (action_mode() == PARSING_MODE) {
-    CHECK_TREE_FALSE(model_);
-    if (!allocator->crfpp_chunker) {
-      allocator->crfpp_chunker = crfpp_model_new_tagger(model_);
-      CHECK_TREE_FALSE(allocator->crfpp_chunker);
-    }
-    crfpp_set_model(allocator->crfpp_chunker, model_);
-    crfpp_clear(allocator->crfpp_chunker);
-  }
-
+  // two columns (surface, POS) per token
   const size_t size = tree->token_size();
-  std::string tmp;
+  TokenCache *cache = allocator->mutable_token_cache();
+  allocator->feature.clear();
   for (size_t i = 0; i < size; ++i) {
-    allocator->feature.clear();
     const Token *token = tree->token(i);
+    TokenInfo *info = cache->find(token, tree->charset(), tree->posset());
     allocator->feature.push_back(token->normalized_surface);
-    if (tree->posset() == IPA || tree->posset() == UNIDIC) {
-      concat_feature(token, 4, &tmp);
-    } else if (tree->posset() == JUMAN) {
-      concat_feature(token, 2, &tmp);
-    }
-    const char *pos = tree->strdup(tmp.c_str());
-    allocator->feature.push_back(pos);
-
-    if (action_mode() == PARSING_MODE) {
-      crfpp_add2(allocator->crfpp_chunker,
-                 allocator->feature.size(),
-                 (const char **)&(allocator->feature[0]));
-    } else {
-      std::copy(allocator->feature.begin(), allocator->feature.end(),
+    allocator->feature.push_back(cache->pos(token, info));
+  }
+
+  return tag(tree, size ? &allocator->feature[0] : 0, 2);
+}
+
+bool Chunker::tag(Tree *tree, const char **x, size_t column_size) const {
+  TreeAllocator *allocator = tree->allocator();
+  CHECK_TREE_FALSE(allocator);
+
+  const size_t size = tree->token_size();
+  if (action_mode() != PARSING_MODE) {
+    for (size_t i = 0; i < size; ++i) {
+      std::copy(x + column_size * i, x + column_size * i + 2,
                 std::ostream_iterator<const char *>(
                     *(allocator->stream()), " "));
-      const char c = (i == 0 || token->chunk) ? 'B' : 'I';
+      const char c = (i == 0 || tree->token(i)->chunk) ? 'B' : 'I';
       *(allocator->stream()) << c << std::endl;
     }
+    *(allocator->stream()) << std::endl;
+    tree->set_output_layer(OUTPUT_CHUNK);
+    return true;
   }
 
-  if (action_mode() == PARSING_MODE) {
+  const CRFLattice *lattice = 0;
+  if (crf_model_.get()) {
+    if (!allocator->crf_lattice) {
+      allocator->crf_lattice = new CRFLattice;
+    }
+    crf_model_->parse(x, size, column_size, allocator->crf_lattice);
+    lattice = allocator->crf_lattice;
+  } else {
+    CHECK_TREE_FALSE(model_);
+    if (!allocator->crfpp_chunker) {
+      allocator->crfpp_chunker = crfpp_model_new_tagger(model_);
+      CHECK_TREE_FALSE(allocator->crfpp_chunker);
+    }
+    crfpp_set_model(allocator->crfpp_chunker, model_);
+    crfpp_clear(allocator->crfpp_chunker);
+    for (size_t i = 0; i < size; ++i) {
+      crfpp_add2(allocator->crfpp_chunker, 2, x + column_size * i);
+    }
     CHECK_TREE_FALSE(crfpp_parse(allocator->crfpp_chunker));
+  }
 
-    tree->clear_chunk();
-    Chunk *old_chunk = 0;
+  tree->clear_chunk();
+  Chunk *old_chunk = 0;
 
-    for (size_t i = 0; i < size; ++i) {
-      Token *token = tree->mutable_token(i);
-      if (!token->chunk &&
-          (i == 0 ||
-           std::strcmp(crfpp_y2(allocator->crfpp_chunker, i), "B") == 0)) {
-        token->chunk = tree->add_chunk();
-      }
-
-      if (token->chunk) {
-        token->chunk->token_pos = i;
-        old_chunk = token->chunk;
-      }
-
-      if (old_chunk) {
-        old_chunk->token_size++;
-      }
+  for (size_t i = 0; i < size; ++i) {
+    Token *token = tree->mutable_token(i);
+    const bool begin = lattice ?
+        (lattice->result[i] == begin_label_) :
+        (std::strcmp(crfpp_y2(allocator->crfpp_chunker, i), "B") == 0);
+    if (!token->chunk && (i == 0 || begin)) {
+      token->chunk = tree->add_chunk();
+    }
+
+    if (token->chunk) {
+      token->chunk->token_pos = i;
+      old_chunk = token->chunk;
+    }
+
+    if (old_chunk) {
+      old_chunk->token_size++;
     }
-  } else {
-    *(allocator->stream()) << std::endl;
   }
 
   tree->set_output_layer(OUTPUT_CHUNK);
@@ -6,22 +6,43 @@
 #ifndef CABOCHA_CHUNKER_H_
 #define CABOCHA_CHUNKER_H_
 #include "analyzer.h"
+#include "scoped_ptr.h"
 
 struct crfpp_t;
 
 namespace CaboCha {
 
+class CRFModel;
+
 class Chunker: public Analyzer {
  public:
   bool open(const Param &param);
   void close();
   bool parse(Tree *tree) const;
 
+  // Chunks the tokens with the columns (surface, POS) of the i-th
+  // token at x[i * column_size].
+  bool tag(Tree *tree, const char **x, size_t column_size) const;
+
   explicit Chunker();
   virtual ~Chunker();
 
  private:
-  crfpp_model_t *model_;
+  scoped_ptr<CRFModel> crf_model_;  // native decoder
+  crfpp_model_t *model_;            // CRF++, used when crf_model_ is 0
+  int begin_label_;
 };
+
+// Trains the CRF++ model of the chunker (TRAIN_CHUNK) or of the named
+// entity tagger (TRAIN_NE) on |train_file| with |thread_size| threads.
+bool runChunkingTrainingWithCRFPP(ParserType type,
+                                  const char *train_file,
+                                  const char *model_file,
+                                  const char *prev_model_file,
+                                  CharsetType charset,
+                                  PossetType posset,
+                                  double cost,
+                                  int freq,
+                                  size_t thread_size);
 }
 #endif
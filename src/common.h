@@ -43,6 +43,8 @@ Copyright(C) 2001-2013 Taku Kudo, All rights reserved.\n"
 #define CABOCHA_FEATURE_SIZE 8192 * 16
 #define CABOCHA_CHUNK_SIZE 128
 #define CABOCHA_TOKEN_SIZE 512
+#define CABOCHA_IO_BUFFER_SIZE 8192 * 16
+#define CABOCHA_TOKEN_CACHE_SIZE 8192 * 4
 
 #ifndef CABOCHA_DEFAULT_POSSET
 #define CABOCHA_DEFAULT_POSSET  "IPA"
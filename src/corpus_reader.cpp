@@ -0,0 +1,89 @@
+// CaboCha -- Yet Another Japanese Dependency Parser
+#include <algorithm>
+#include <cstring>
+#include "cabocha.h"
+#include "corpus_reader.h"
+
+namespace CaboCha {
+
+bool CorpusReader::open(const char *filename, int input_layer) {
+  this->close();
+  input_layer_ = input_layer;
+
+#if !defined(_WIN32) || defined(__CYGWIN__)
+  // pipes cannot be mapped, and an empty file cannot be mmap()ed.
+  struct stat st;
+  CHECK_FALSE(::stat(filename, &st) == 0 && S_ISREG(st.st_mode))
+      << "not a regular file: " << filename;
+  if (st.st_size == 0) {
+    return true;
+  }
+#endif
+
+  CHECK_FALSE(mmap_.open(filename)) << mmap_.what();
+
+  const char *begin = mmap_.begin();
+  const char *end = mmap_.end();
+  index_.push_back(0);
+  for (const char *line = begin; line < end;) {
+    const char *eol = static_cast<const char *>(
+        std::memchr(line, '\n', end - line));
+    const char *next = eol ? eol + 1 : end;
+    if (!eol) {
+      eol = end;
+    }
+    if (input_layer == INPUT_RAW_SENTENCE ||
+        eol == line ||
+        (eol - line == 3 && std::strncmp(line, "EOS", 3) == 0)) {
+      index_.push_back(next - begin);
+    }
+    line = next;
+  }
+
+  // trailing lines without EOS form the last sentence.
+  if (index_.back() != mmap_.size()) {
+    index_.push_back(mmap_.size());
+  }
+
+  return true;
+}
+
+void CorpusReader::close() {
+  mmap_.close();
+  index_.clear();
+}
+
+const char *CorpusReader::sentence(size_t i) const {
+  return mmap_.begin() + index_[i];
+}
+
+size_t CorpusReader::sentence_length(size_t i) const {
+  size_t length = index_[i + 1] - index_[i];
+  if (input_layer_ == INPUT_RAW_SENTENCE &&
+      length > 0 && mmap_[index_[i + 1] - 1] == '\n') {
+    --length;
+  }
+  return length;
+}
+
+void CorpusReader::split(size_t n, std::vector<size_t> *range) const {
+  range->clear();
+  range->push_back(0);
+  if (n == 0) {
+    range->push_back(size());
+    return;
+  }
+  if (size() == 0) {
+    range->resize(n + 1, 0);
+    return;
+  }
+  const size_t total = index_.back();
+  for (size_t k = 1; k < n; ++k) {
+    const size_t offset = total / n * k;
+    const size_t i = std::lower_bound(index_.begin(), index_.end() - 1,
+                                      offset) - index_.begin();
+    range->push_back(std::max(range->back(), i));
+  }
+  range->push_back(size());
+}
+}
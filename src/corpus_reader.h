@@ -0,0 +1,43 @@
+// CaboCha -- Yet Another Japanese Dependency Parser
+#ifndef CABOCHA_CORPUS_READER_H_
+#define CABOCHA_CORPUS_READER_H_
+
+#include <vector>
+#include "common.h"
+#include "mmap.h"
+
+namespace CaboCha {
+
+// Reads a corpus file through mmap. Sentence boundaries are indexed
+// at open(), and each sentence is returned as a view into the mapped
+// file. No data is copied. A raw sentence is one line without its
+// '\n'. A layered sentence runs up to and including the "EOS" or
+// blank line that ends it.
+class CorpusReader {
+ public:
+  bool open(const char *filename, int input_layer);
+  void close();
+
+  size_t size() const { return index_.empty() ? 0 : index_.size() - 1; }
+  const char *sentence(size_t i) const;
+  size_t sentence_length(size_t i) const;
+
+  // Splits the sentences into |n| contiguous ranges of roughly the
+  // same byte size. The k-th range is [(*range)[k], (*range)[k+1]).
+  // |range| always has n + 1 entries (2 when n is 0), and some of
+  // the ranges are empty when there are fewer sentences than n.
+  void split(size_t n, std::vector<size_t> *range) const;
+
+  const char *what() { return what_.str(); }
+
+  CorpusReader(): input_layer_(0) {}
+  virtual ~CorpusReader() { this->close(); }
+
+ private:
+  Mmap<char>           mmap_;
+  std::vector<size_t>  index_;  // begin offsets + the file size
+  int                  input_layer_;
+  whatlog              what_;
+};
+}
+#endif
@@ -0,0 +1,342 @@
+// CaboCha -- Yet Another Japanese Dependency Parser
+#include <algorithm>
+#include <cstring>
+#include <vector>
+#include "common.h"
+#include "crf.h"
+#include "mmap.h"
+#include "utils.h"
+
+namespace CaboCha {
+namespace {
+const unsigned int kCRFPPModelVersion = 100;
+const int kEOSSize = 8;
+const char *BOS[] = { "_B-1", "_B-2", "_B-3", "_B-4",
+                      "_B-5", "_B-6", "_B-7", "_B-8" };
+const char *EOS[] = { "_B+1", "_B+2", "_B+3", "_B+4",
+                      "_B+5", "_B+6", "_B+7", "_B+8" };
+
+// parses "[row,col]" after "%x" in the same way as CRF++.
+bool get_index(const char **p, int *row, int *col) {
+  const char *s = *p;
+  if (*s++ != '[') return false;
+  int neg = 1;
+  if (*s == '-') {
+    neg = -1;
+    ++s;
+  }
+  *row = 0;
+  for (; *s != ','; ++s) {
+    if (*s < '0' || *s > '9') return false;
+    *row = 10 * *row + (*s - '0');
+  }
+  ++s;
+  *col = 0;
+  for (; *s != ']'; ++s) {
+    if (*s < '0' || *s > '9') return false;
+    *col = 10 * *col + (*s - '0');
+  }
+  *row *= neg;
+  *p = s + 1;
+  return true;
+}
+}  // namespace
+
+CRFModel::CRFModel()
+    : array_(0), array_size_(0), alpha_(0),
+      maxid_(0), xsize_(0), cost_factor_(0.0) {}
+
+CRFModel::~CRFModel() {}
+
+void CRFModel::close() {
+  mmap_.close();
+  y_.clear();
+  unigram_templs_.clear();
+  bigram_templs_.clear();
+  pieces_.clear();
+  array_ = 0;
+  array_size_ = 0;
+  alpha_ = 0;
+  maxid_ = 0;
+  xsize_ = 0;
+  cost_factor_ = 0.0;
+}
+
+bool CRFModel::traverse(int *node, const char *str, size_t length) const {
+  int b = *node;
+  for (size_t i = 0; i < length; ++i) {
+    const size_t p = static_cast<size_t>(b) +
+        static_cast<unsigned char>(str[i]) + 1;
+    if (p >= array_size_ ||
+        array_[p].check != static_cast<unsigned int>(b)) {
+      return false;
+    }
+    b = array_[p].base;
+    if (b < 0) {
+      return false;
+    }
+  }
+  *node = b;
+  return true;
+}
+
+int CRFModel::find(int node) const {
+  const size_t p = static_cast<size_t>(node);
+  if (p < array_size_ &&
+      array_[p].check == static_cast<unsigned int>(node) &&
+      array_[p].base < 0) {
+    return -array_[p].base - 1;
+  }
+  return -1;
+}
+
+bool CRFModel::compile(const char *templ, std::vector<Template> *templs) {
+  Template t;
+  t.node = array_[0].base;
+  t.piece = pieces_.size();
+  t.piece_size = 0;
+
+  bool has_index = false;
+  const char *p = templ;
+  while (*p) {
+    const char *literal = p;
+    while (*p && !(p[0] == '%' && p[1] == 'x')) {
+      CHECK_FALSE(*p != '%') << "unknown template: " << templ;
+      ++p;
+    }
+    if (p > literal) {
+      const size_t length = static_cast<size_t>(p - literal);
+      if (!has_index) {
+        if (!traverse(&t.node, literal, length)) {
+          t.node = -1;  // never fires
+        }
+      } else {
+        Piece piece = { literal, length, 0, 0 };
+        pieces_.push_back(piece);
+      }
+    }
+    if (*p == '\0') {
+      break;
+    }
+    p += 2;  // %x
+    Piece piece = { 0, 0, 0, 0 };
+    CHECK_FALSE(get_index(&p, &piece.row, &piece.col))
+        << "unknown template: " << templ;
+    CHECK_FALSE(piece.row >= -kEOSSize && piece.row <= kEOSSize &&
+                piece.col >= 0 &&
+                piece.col < static_cast<int>(xsize_))
+        << "index out of range: " << templ;
+    pieces_.push_back(piece);
+    has_index = true;
+  }
+  t.piece_size = pieces_.size() - t.piece;
+
+  // a template without %x fires at every position, so the key must
+  // be there. This also rejects an index in a different layout.
+  if (!has_index) {
+    CHECK_FALSE(t.node >= 0 && find(t.node) >= 0)
+        << "feature index is broken: " << templ;
+  }
+
+  if (t.node >= 0) {
+    templs->push_back(t);
+  }
+
+  return true;
+}
+
+bool CRFModel::open(const char *filename) {
+  close();
+
+  CHECK_FALSE(mmap_.open(filename)) << mmap_.what();
+  const char *ptr = mmap_.begin();
+  const char *end = mmap_.end();
+
+  const size_t kHeaderSize = 2 * sizeof(unsigned int) + sizeof(double) +
+      4 * sizeof(unsigned int);
+  CHECK_FALSE(mmap_.size() >= kHeaderSize)
+      << "model file is broken: " << filename;
+
+  unsigned int version = 0;
+  int type = 0;
+  unsigned int dsize = 0;
+  read_static<unsigned int>(&ptr, version);
+  CHECK_FALSE(version / 100 == kCRFPPModelVersion / 100)
+      << "not a CRF++ binary model: " << filename;
+  read_static<int>(&ptr, type);
+  CHECK_FALSE(type == 0) << "unsupported model type: " << type;
+  read_static<double>(&ptr, cost_factor_);
+  read_static<unsigned int>(&ptr, maxid_);
+  read_static<unsigned int>(&ptr, xsize_);
+  read_static<unsigned int>(&ptr, dsize);
+
+  unsigned int y_str_size = 0;
+  read_static<unsigned int>(&ptr, y_str_size);
+  CHECK_FALSE(ptr + y_str_size + sizeof(unsigned int) <= end)
+      << "model file is broken: " << filename;
+  const char *y_str = read_ptr(&ptr, y_str_size);
+  unsigned int tmpl_str_size = 0;
+  read_static<unsigned int>(&ptr, tmpl_str_size);
+  CHECK_FALSE(ptr + tmpl_str_size <= end)
+      << "model file is broken: " << filename;
+  const char *tmpl_str = read_ptr(&ptr, tmpl_str_size);
+
+  CHECK_FALSE(dsize % sizeof(Unit) == 0 && dsize > 0 &&
+              static_cast<size_t>(end - ptr) ==
+              dsize + sizeof(float) * static_cast<size_t>(maxid_))
+      << "model file is broken: " << filename;
+  array_ = reinterpret_cast<const Unit *>(ptr);
+  array_size_ = dsize / sizeof(Unit);
+  ptr += dsize;
+  alpha_ = reinterpret_cast<const float *>(ptr);
+
+  CHECK_FALSE(y_str_size > 0 && y_str[y_str_size - 1] == '\0' &&
+              (tmpl_str_size == 0 || tmpl_str[tmpl_str_size - 1] == '\0'))
+      << "model file is broken: " << filename;
+  for (size_t pos = 0; pos < y_str_size;) {
+    y_.push_back(y_str + pos);
+    pos += std::strlen(y_str + pos) + 1;
+  }
+  CHECK_FALSE(y_.size() >= 2 && y_.size() < 0xffff)
+      << "invalid label size: " << y_.size();
+
+  for (size_t pos = 0; pos < tmpl_str_size;) {
+    const char *templ = tmpl_str + pos;
+    pos += std::strlen(templ) + 1;
+    if (templ[0] == '\0') {
+      continue;  // padding
+    } else if (templ[0] == 'U') {
+      CHECK_FALSE(compile(templ, &unigram_templs_));
+    } else if (templ[0] == 'B') {
+      CHECK_FALSE(compile(templ, &bigram_templs_));
+    } else {
+      CHECK_FALSE(false) << "unknown template type: " << templ;
+    }
+  }
+
+  return true;
+}
+
+int CRFModel::yid(const char *name) const {
+  for (size_t i = 0; i < y_.size(); ++i) {
+    if (std::strcmp(y_[i], name) == 0) {
+      return static_cast<int>(i);
+    }
+  }
+  return -1;
+}
+
+int CRFModel::feature_id(const Template &templ, const char **x,
+                         size_t size, size_t column_size, int pos) const {
+  int node = templ.node;
+  for (size_t i = templ.piece; i < templ.piece + templ.piece_size; ++i) {
+    const Piece &piece = pieces_[i];
+    if (piece.length) {
+      if (!traverse(&node, piece.str, piece.length)) {
+        return -1;
+      }
+      continue;
+    }
+    const int idx = pos + piece.row;
+    const char *str = 0;
+    if (idx < 0) {
+      str = BOS[-idx - 1];
+    } else if (idx >= static_cast<int>(size)) {
+      str = EOS[idx - size];
+    } else {
+      str = x[idx * column_size + piece.col];
+    }
+    if (!traverse(&node, str, std::strlen(str))) {
+      return -1;
+    }
+  }
+  return find(node);
+}
+
+void CRFModel::parse(const char **x, size_t size, size_t column_size,
+                     CRFLattice *lattice) const {
+  const size_t ysize = y_.size();
+  lattice->result.resize(size);
+  if (size == 0) {
+    return;
+  }
+  lattice->cost.resize(ysize * ysize);
+  lattice->node_cost.resize(size * ysize);
+  lattice->path_cost.resize(size * ysize * ysize);
+  lattice->best_cost.resize(size * ysize);
+  lattice->prev.resize(size * ysize);
+
+  // The weights are summed up in float and then scaled, as CRF++
+  // does, so that ties are broken in the same way.
+  float *cost = &lattice->cost[0];
+  for (size_t i = 0; i < size; ++i) {
+    std::fill(cost, cost + ysize, 0.0f);
+    for (size_t k = 0; k < unigram_templs_.size(); ++k) {
+      const int id = feature_id(unigram_templs_[k], x, size,
+                                column_size, static_cast<int>(i));
+      if (id >= 0 && id + ysize <= maxid_) {
+        for (size_t y = 0; y < ysize; ++y) {
+          cost[y] += alpha_[id + y];
+        }
+      }
+    }
+    for (size_t y = 0; y < ysize; ++y) {
+      lattice->node_cost[i * ysize + y] = cost_factor_ * cost[y];
+    }
+
+    if (i == 0) {
+      continue;
+    }
+    std::fill(cost, cost + ysize * ysize, 0.0f);
+    for (size_t k = 0; k < bigram_templs_.size(); ++k) {
+      const int id = feature_id(bigram_templs_[k], x, size,
+                                column_size, static_cast<int>(i));
+      if (id >= 0 && id + ysize * ysize <= maxid_) {
+        for (size_t y = 0; y < ysize * ysize; ++y) {
+          cost[y] += alpha_[id + y];
+        }
+      }
+    }
+    for (size_t y = 0; y < ysize * ysize; ++y) {
+      lattice->path_cost[i * ysize * ysize + y] = cost_factor_ * cost[y];
+    }
+  }
+
+  // Viterbi
+  for (size_t y = 0; y < ysize; ++y) {
+    lattice->best_cost[y] = lattice->node_cost[y];
+    lattice->prev[y] = -1;
+  }
+  for (size_t i = 1; i < size; ++i) {
+    const double *path_cost = &lattice->path_cost[i * ysize * ysize];
+    const double *left = &lattice->best_cost[(i - 1) * ysize];
+    for (size_t y = 0; y < ysize; ++y) {
+      double best = -1e37;
+      int prev = -1;
+      for (size_t ly = 0; ly < ysize; ++ly) {
+        const double c = left[ly] + path_cost[ly * ysize + y] +
+            lattice->node_cost[i * ysize + y];
+        if (c > best) {
+          best = c;
+          prev = static_cast<int>(ly);
+        }
+      }
+      lattice->best_cost[i * ysize + y] = best;
+      lattice->prev[i * ysize + y] = prev;
+    }
+  }
+
+  double best = -1e37;
+  int y = 0;
+  for (size_t k = 0; k < ysize; ++k) {
+    if (best < lattice->best_cost[(size - 1) * ysize + k]) {
+      best = lattice->best_cost[(size - 1) * ysize + k];
+      y = static_cast<int>(k);
+    }
+  }
+  for (size_t i = size; i > 0; --i) {
+    lattice->result[i - 1] = static_cast<unsigned short>(y);
+    y = std::max(0, lattice->prev[(i - 1) * ysize + y]);
+  }
+}
+}
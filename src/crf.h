@@ -0,0 +1,96 @@
+// CaboCha -- Yet Another Japanese Dependency Parser
+#ifndef CABOCHA_CRF_H_
+#define CABOCHA_CRF_H_
+
+#include <vector>
+#include "common.h"
+#include "mmap.h"
+
+namespace CaboCha {
+
+// Per-thread work area of CRFModel::parse(). |result| holds the
+// label ids of the last sentence.
+struct CRFLattice {
+  std::vector<float>          cost;       // feature weights summed up
+  std::vector<double>         node_cost;  // [position][label]
+  std::vector<double>         path_cost;  // [position][left][label]
+  std::vector<double>         best_cost;
+  std::vector<int>            prev;
+  std::vector<unsigned short> result;
+};
+
+// Linear-chain CRF decoder for the binary models written by CRF++
+// (crf_learn or cabocha-model-index). The model is mmap()ed as it
+// is. A template feature is looked up by walking the model's
+// double-array over the template text and the token columns, so no
+// feature string is built, and the labels are decoded with Viterbi.
+// The decoder gives the same labels as CRF++'s default (non-nbest)
+// mode.
+class CRFModel {
+ public:
+  bool open(const char *filename);
+  void close();
+
+  size_t ysize() const { return y_.size(); }
+  const char *yname(size_t y) const { return y_[y]; }
+  size_t xsize() const { return xsize_; }
+
+  // Returns the id of the label |name|, or -1.
+  int yid(const char *name) const;
+
+  // Tags |size| tokens. The j-th column of the i-th token is
+  // x[i * column_size + j], and column_size must not be less than
+  // xsize(). The label ids are stored in lattice->result.
+  void parse(const char **x, size_t size, size_t column_size,
+             CRFLattice *lattice) const;
+
+  const char *what() { return what_.str(); }
+
+  CRFModel();
+  virtual ~CRFModel();
+
+ private:
+  // a double-array unit of darts 0.3x used by CRF++
+  struct Unit {
+    int          base;
+    unsigned int check;
+  };
+
+  // a compiled template "U01:%x[-1,0]/%x[0,0]": |node| is the
+  // double-array node after "U01:", and |piece_size| pieces follow
+  // from |piece|.
+  struct Template {
+    int    node;
+    size_t piece;
+    size_t piece_size;
+  };
+
+  // a literal string (|length| > 0) or %x[row,col]
+  struct Piece {
+    const char *str;
+    size_t      length;
+    int         row;
+    int         col;
+  };
+
+  bool compile(const char *templ, std::vector<Template> *templs);
+  bool traverse(int *node, const char *str, size_t length) const;
+  int  find(int node) const;
+  int  feature_id(const Template &templ, const char **x,
+                  size_t size, size_t column_size, int pos) const;
+
+  Mmap<char>                mmap_;
+  std::vector<const char *> y_;
+  std::vector<Template>     unigram_templs_;
+  std::vector<Template>     bigram_templs_;
+  std::vector<Piece>        pieces_;
+  const Unit               *array_;
+  size_t                    array_size_;
+  const float              *alpha_;
+  unsigned int              maxid_;
+  unsigned int              xsize_;
+  double                    cost_factor_;
+  whatlog                   what_;
+};
+}
+#endif
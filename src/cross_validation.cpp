@@ -0,0 +1,448 @@
+// CaboCha -- Yet Another Japanese Dependency Parser
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <sstream>
+#include <streambuf>
+#include <string>
+#include <vector>
+#include "cabocha.h"
+#include "common.h"
+#include "corpus_reader.h"
+#include "dep.h"
+#include "eval.h"
+#include "param.h"
+#include "scoped_ptr.h"
+#include "selector.h"
+#include "svm.h"
+#include "thread.h"
+#include "timer.h"
+#include "tree_allocator.h"
+#include "ucs.h"
+#include "utils.h"
+
+namespace CaboCha {
+namespace {
+
+// Splits the comma-separated |str| into |list|.
+template <class T>
+void split_list(const std::string &str, std::vector<T> *list) {
+  std::vector<char> buf(str.begin(), str.end());
+  buf.push_back('\0');
+  std::vector<char *> col;
+  tokenize2(&buf[0], ",", std::back_inserter(col), buf.size());
+  list->clear();
+  for (size_t i = 0; i < col.size(); ++i) {
+    list->push_back(lexical_cast<T, std::string>(col[i]));
+  }
+  CHECK_DIE(!list->empty()) << "empty list: " << str;
+}
+
+// Discards everything written to it. The progress of the learners
+// is useless while the folds are trained at the same time.
+class null_streambuf : public std::streambuf {
+ protected:
+  int overflow(int c) { return traits_type::not_eof(c); }
+};
+
+struct Setting {
+  double cost;
+  size_t freq_feature_size;
+  double sigma;
+  size_t minsup;
+};
+
+struct FoldResult {
+  DependencyEval eval;
+  size_t         model_size;
+  size_t         classify_size;  // classify() calls on the test fold
+  double         classify_time;  // seconds spent by the dependency parser
+  FoldResult() : model_size(0), classify_size(0), classify_time(0.0) {}
+};
+
+// The sentence i is in the test set of the fold i % fold_size, and in
+// the training sets of the others. A job trains the model of a fold
+// for a pair of cost and freq-feature-size once, and compiles it for
+// every pair of sigma and minsup. The jobs run on several threads;
+// the compiled models are tested after all of them finish, on one
+// thread, so that the classification speed does not depend on the
+// number of threads.
+class CrossValidation {
+ public:
+  const CorpusReader  *reader;
+  size_t               fold_size;
+  CharsetType          charset;
+  PossetType           posset;
+  std::string          rcfile;  // head-rule and func-rule, if given
+  std::string          prefix;
+  std::vector<double>  cost;
+  std::vector<size_t>  freq_feature_size;
+  std::vector<double>  sigma;
+  std::vector<size_t>  minsup;
+  std::vector<Setting>    setting;
+  std::vector<FoldResult> result;  // [setting * fold_size + fold]
+
+  size_t job_size() const {
+    return fold_size * cost.size() * freq_feature_size.size();
+  }
+
+  size_t setting_id(size_t c, size_t f, size_t s, size_t m) const {
+    return ((c * freq_feature_size.size() + f) * sigma.size() + s)
+        * minsup.size() + m;
+  }
+
+  // Sets the head-rule and func-rule of |rcfile| to |param|.
+  void loadRules(Param *param) const {
+    if (!rcfile.empty()) {
+      CHECK_DIE(load_selector_rules(rcfile.c_str(), param))
+          << "no such file or directory: " << rcfile;
+    }
+  }
+
+  std::string train_file(size_t fold) const {
+    std::ostringstream os;
+    os << prefix << ".fold" << fold << ".train";
+    return os.str();
+  }
+
+  std::string model_file(size_t id, size_t fold) const {
+    std::ostringstream os;
+    os << prefix << ".setting" << id << ".fold" << fold
+       << ".model";
+    return os.str();
+  }
+
+  void init() {
+    setting.clear();
+    for (size_t c = 0; c < cost.size(); ++c) {
+      for (size_t f = 0; f < freq_feature_size.size(); ++f) {
+        for (size_t s = 0; s < sigma.size(); ++s) {
+          for (size_t m = 0; m < minsup.size(); ++m) {
+            Setting st;
+            st.cost = cost[c];
+            st.freq_feature_size = freq_feature_size[f];
+            st.sigma = sigma[s];
+            st.minsup = minsup[m];
+            setting.push_back(st);
+          }
+        }
+      }
+    }
+    result.clear();
+    result.resize(setting.size() * fold_size);
+  }
+
+  void writeFolds() const {
+    scoped_array<std::ofstream> ofs(new std::ofstream[fold_size]);
+    for (size_t k = 0; k < fold_size; ++k) {
+      const std::string filename = train_file(k);
+      ofs[k].open(WPATH(filename.c_str()), std::ios::binary|std::ios::out);
+      CHECK_DIE(ofs[k]) << "permission denied: " << filename;
+    }
+    for (size_t i = 0; i < reader->size(); ++i) {
+      for (size_t k = 0; k < fold_size; ++k) {
+        if (i % fold_size != k) {
+          ofs[k].write(reader->sentence(i), reader->sentence_length(i));
+        }
+      }
+    }
+    for (size_t k = 0; k < fold_size; ++k) {
+      CHECK_DIE(ofs[k]) << "write() failed: " << train_file(k);
+    }
+  }
+
+  void removeFolds() const {
+    for (size_t k = 0; k < fold_size; ++k) {
+      Unlink(train_file(k).c_str());
+    }
+  }
+
+  void runJob(size_t job) {
+    const size_t fold = job % fold_size;
+    const size_t c = job / fold_size / freq_feature_size.size();
+    const size_t f = job / fold_size % freq_feature_size.size();
+
+    null_streambuf null;
+    std::ostream quiet(&null);
+
+    Param rule_param;
+    loadRules(&rule_param);
+
+    scoped_ptr<SVMModel> model(
+        trainDependencyModel(train_file(fold).c_str(), 0,
+                             charset, posset, rule_param, cost[c],
+                             freq_feature_size[f], 1, false, 0, false,
+                             &quiet));
+    CHECK_DIE(model.get());
+
+    Iconv iconv;
+    CHECK_DIE(iconv.open(charset, charset));
+
+    for (size_t s = 0; s < sigma.size(); ++s) {
+      for (size_t m = 0; m < minsup.size(); ++m) {
+        const std::string file =
+            model_file(setting_id(c, f, s, m), fold);
+        CHECK_DIE(FastSVMModel::compile(model.get(), file.c_str(),
+                                        sigma[s], minsup[m],
+                                        freq_feature_size[f], 1, &iconv,
+                                        &quiet));
+      }
+    }
+
+    std::cerr << "fold " << fold << " cost " << cost[c]
+              << " freq-feature-size " << freq_feature_size[f]
+              << " done" << std::endl;
+  }
+
+  // Tests and removes the compiled models of all the jobs.
+  void testModels() {
+    for (size_t i = 0; i < setting.size(); ++i) {
+      for (size_t k = 0; k < fold_size; ++k) {
+        const std::string file = model_file(i, k);
+        test(k, file.c_str(), &result[i * fold_size + k]);
+        Unlink(file.c_str());
+      }
+    }
+  }
+
+  void test(size_t fold, const char *file, FoldResult *r) const {
+    {
+      std::ifstream ifs(WPATH(file), std::ios::binary|std::ios::in);
+      CHECK_DIE(ifs) << "no such file or directory: " << file;
+      ifs.seekg(0, std::ios::end);
+      r->model_size = static_cast<size_t>(ifs.tellg());
+    }
+
+    Param param;
+    loadRules(&param);
+    param.set<std::string>("parser-model", file);
+
+    Selector selector;
+    selector.set_charset(charset);
+    selector.set_posset(posset);
+    selector.set_action_mode(PARSING_MODE);
+    CHECK_DIE(selector.open(param)) << selector.what();
+
+    DependencyParser parser;
+    parser.set_charset(charset);
+    parser.set_posset(posset);
+    parser.set_action_mode(PARSING_MODE);
+    CHECK_DIE(parser.open(param)) << parser.what();
+
+    Tree tree;
+    tree.set_charset(charset);
+    tree.set_posset(posset);
+
+    std::vector<int> answer;
+    std::vector<int> link;
+    wall_timer timer;
+    for (size_t i = fold; i < reader->size(); i += fold_size) {
+      CHECK_DIE(tree.read(reader->sentence(i),
+                          reader->sentence_length(i),
+                          INPUT_CHUNK)) << "cannot parse sentence";
+      CHECK_DIE(selector.parse(&tree)) << selector.what();
+      answer.clear();
+      for (size_t j = 0; j < tree.chunk_size(); ++j) {
+        answer.push_back(tree.chunk(j)->link);
+      }
+
+      timer.restart();
+      CHECK_DIE(parser.parse(&tree)) << parser.what();
+      r->classify_time += timer.elapsed();
+
+      link.clear();
+      for (size_t j = 0; j < tree.chunk_size(); ++j) {
+        link.push_back(tree.chunk(j)->link);
+      }
+      r->eval.add(answer, link);
+    }
+
+    r->classify_size = tree.allocator()->dep_classify_size;
+  }
+
+  void print(std::ostream *os) const {
+    char buf[256];
+    *os << "    cost     sigma minsup  freq  dependency    sentence"
+        "  model size  classify/s" << std::endl;
+    size_t best = 0;
+    double best_accuracy = -1.0;
+    for (size_t i = 0; i < setting.size(); ++i) {
+      DependencyEval eval;
+      double model_size = 0.0;
+      size_t classify_size = 0;
+      double classify_time = 0.0;
+      for (size_t k = 0; k < fold_size; ++k) {
+        const FoldResult &r = result[i * fold_size + k];
+        eval.merge(r.eval);
+        model_size += r.model_size;
+        classify_size += r.classify_size;
+        classify_time += r.classify_time;
+      }
+      const double accuracy = eval.accuracy(1);
+      if (accuracy > best_accuracy) {
+        best_accuracy = accuracy;
+        best = i;
+      }
+      snprintf(buf, sizeof(buf) - 1,
+               "%8.6g %9.6g %6d %5d %11.4f %11.4f %11.0f %11.0f\n",
+               setting[i].cost,
+               setting[i].sigma,
+               static_cast<int>(setting[i].minsup),
+               static_cast<int>(setting[i].freq_feature_size),
+               accuracy,
+               eval.sentence_accuracy(),
+               model_size / fold_size,
+               classify_time == 0.0 ? 0.0 : classify_size / classify_time);
+      *os << buf;
+    }
+    *os << "\nbest: -c " << setting[best].cost
+        << " -s " << setting[best].sigma
+        << " -n " << setting[best].minsup
+        << " -F " << setting[best].freq_feature_size << std::endl;
+  }
+
+  CrossValidation()
+      : reader(0), fold_size(0),
+        charset(EUC_JP), posset(IPA), next_job_(0) {}
+
+  int nextJob() { return atomic_add(&next_job_, 1) - 1; }
+
+ private:
+  volatile int next_job_;
+};
+
+class Worker : public thread {
+ public:
+  CrossValidation *cv;
+
+  void run() {
+    for (;;) {
+      const int job = cv->nextJob();
+      if (job >= static_cast<int>(cv->job_size())) {
+        break;
+      }
+      cv->runJob(job);
+    }
+  }
+
+  Worker() : cv(0) {}
+};
+
+int cross_validation(int argc, char **argv) {
+  static const CaboCha::Option long_options[] = {
+    {"fold",     'k', "5",      "INT",
+     "split the corpus into INT folds (default 5)" },
+    {"cost",     'c', "0.0015", "FLOAT[,FLOAT...]",
+     "set cost parameters to try (default 0.0015)" },
+    {"sigma",    's', "0.001",  "FLOAT[,FLOAT...]",
+     "set minimum feature weights for PKE approximation to try "
+     "(default 0.001)" },
+    {"minsup",   'n', "2",      "INT[,INT...]",
+     "set minimum frequency supports for PKE approximation to try "
+     "(default 2)" },
+    {"freq-feature-size", 'F', "3000", "INT[,INT...]",
+     "set sizes of frequent features to try (default 3000)" },
+    {"threads",  'p', "1",      "INT",
+     "number of folds trained at the same time (default 1)" },
+    {"rcfile",   'r', 0,        "FILE",
+     "use the head-rule and func-rule of FILE" },
+    {"work-prefix", 'w', 0,     "STR",
+     "write the temporary fold and model files to STR.* "
+     "(default CORPUS)" },
+    { "charset",   't',  CABOCHA_DEFAULT_CHARSET, "ENC",
+      "set parser charset to ENC (default "
+      CABOCHA_DEFAULT_CHARSET ")" },
+    { "posset",         'P',  CABOCHA_DEFAULT_POSSET, "STR",
+      "set parser posset to STR (default "
+      CABOCHA_DEFAULT_POSSET ")" },
+    {"version",  'v', 0,        0,       "show the version and exit" },
+    {"help",     'h', 0,        0,       "show this help and exit" },
+    {0, 0, 0, 0, 0}
+  };
+
+  CaboCha::Param param;
+  param.open(argc, argv, long_options);
+
+  if (!param.help_version()) {
+    return 0;
+  }
+
+  const std::vector<std::string> &rest = param.rest_args();
+  if (rest.size() != 1) {
+    std::cout << param.help();
+    return 0;
+  }
+
+  CorpusReader reader;
+  CHECK_DIE(reader.open(rest[0].c_str(), INPUT_CHUNK)) << reader.what();
+
+  CrossValidation cv;
+  cv.reader = &reader;
+  cv.fold_size = param.get<size_t>("fold");
+  cv.charset = decode_charset(param.get<std::string>("charset").c_str());
+  cv.posset = decode_posset(param.get<std::string>("posset").c_str());
+  cv.rcfile = param.get<std::string>("rcfile");
+  {
+    Param rule_param;
+    cv.loadRules(&rule_param);
+  }
+  cv.prefix = param.get<std::string>("work-prefix");
+  if (cv.prefix.empty()) {
+    cv.prefix = rest[0];
+  }
+  split_list(param.get<std::string>("cost"), &cv.cost);
+  split_list(param.get<std::string>("freq-feature-size"),
+             &cv.freq_feature_size);
+  split_list(param.get<std::string>("sigma"), &cv.sigma);
+  split_list(param.get<std::string>("minsup"), &cv.minsup);
+
+  CHECK_DIE(cv.fold_size >= 2) << "fold must be 2 or more";
+  CHECK_DIE(reader.size() >= cv.fold_size)
+      << "the corpus has fewer sentences than folds";
+
+  size_t thread_size = param.get<size_t>("threads");
+  CHECK_DIE(thread_size > 0) << "thread size must be positive value";
+  thread_size = std::min(thread_size, cv.job_size());
+
+  cv.init();
+  std::cout << reader.size() << " sentences, " << cv.fold_size
+            << " folds, " << cv.setting.size() << " settings, "
+            << cv.job_size() << " jobs on " << thread_size
+            << " threads" << std::endl;
+
+  cv.writeFolds();
+
+  wall_timer timer;
+  {
+    scoped_array<Worker> worker(new Worker[thread_size]);
+    for (size_t i = 0; i < thread_size; ++i) {
+      worker[i].cv = &cv;
+    }
+    if (thread_size == 1) {
+      worker[0].run();
+    } else {
+      for (size_t i = 0; i < thread_size; ++i) {
+        worker[i].start();
+      }
+      for (size_t i = 0; i < thread_size; ++i) {
+        worker[i].join();
+      }
+    }
+  }
+
+  cv.removeFolds();
+  cv.testModels();
+
+  std::cout << "done in " << timer.elapsed() << " s\n" << std::endl;
+  cv.print(&std::cout);
+
+  return 0;
+}
+}  // namespace
+}
+
+// exports
+int cabocha_cross_validation(int argc, char **argv) {
+  return CaboCha::cross_validation(argc, argv);
+}
@@ -12,6 +12,7 @@
 #include "cabocha.h"
 #include "common.h"
 #include "dep.h"
+#include "example_set.h"
 #include "param.h"
 #include "svm.h"
 #include "timer.h"
@@ -57,7 +58,7 @@ Hypothesis *DependencyParserData::hypothesis() {
 DependencyParserData::DependencyParserData() : hypothesis_(0) {}
 DependencyParserData::~DependencyParserData() {}
 
-DependencyParser::DependencyParser() : svm_(0) {}
+DependencyParser::DependencyParser() : svm_(0), example_set_(0) {}
 
 DependencyParser::~DependencyParser() {}
 
@@ -94,6 +95,7 @@ bool DependencyParser::open(const Param &param) {
 
   if (action_mode() == TRAINING_MODE) {
     svm_.reset(new SVMModel);
+    example_set_.reset(new ExampleSet);
   }
 
   return true;
@@ -101,6 +103,7 @@ bool DependencyParser::open(const Param &param) {
 
 void DependencyParser::close() {
   svm_.reset(0);
+  example_set_.reset(0);
 }
 
 void ChunkInfo::clear() {
@@ -300,12 +303,13 @@ bool DependencyParser::estimate(const Tree *tree, int src, int dst,
   fp->erase(std::unique(fp->begin(), fp->end()), fp->end());
 
   if (action_mode() == PARSING_MODE) {
+    ++tree->allocator()->dep_classify_size;
     *score = svm_->classify(*fp);
     return *score > 0;
   } else {
     CHECK_DIE(!fp->empty());
     const bool isdep = (tree->chunk(src)->link == dst);
-    svm_->add(isdep ? +1 : -1, *fp);
+    example_set_->add(isdep ? +1 : -1, *fp);
     return isdep;
   }
 
@@ -15,6 +15,8 @@
 
 namespace CaboCha {
 
+class ExampleSet;
+class SVMModel;
 class SVMModelInterface;
 
 struct Hypothesis {
@@ -69,6 +71,11 @@ class DependencyParser: public Analyzer {
     return svm_.get();
   }
 
+  // examples collected in TRAINING_MODE
+  ExampleSet *mutable_example_set() {
+    return example_set_.get();
+  }
+
   explicit DependencyParser();
   virtual ~DependencyParser();
 
@@ -80,6 +87,29 @@ class DependencyParser: public Analyzer {
                 double *score) const;
 
   scoped_ptr<SVMModelInterface> svm_;
+  scoped_ptr<ExampleSet>        example_set_;
 };
+
+// The default size of the frequent features (-F of cabocha-learn).
+const size_t kDefaultFreqFeatureSize = 3000;
+
+// Trains the SVM model of the dependency parser on |train_file| and
+// returns it, or retrains |prev_model_file| if given. The caller
+// saves or compiles the model and deletes it. The examples are kept
+// in |spill_file| during training unless it is NULL. The selector
+// uses the head-rule and func-rule of |rule_param|, or the built-in
+// rules when they are not set. The progress is written to |os|.
+SVMModel *trainDependencyModel(const char *train_file,
+                               const char *prev_model_file,
+                               CharsetType charset,
+                               PossetType posset,
+                               const Param &rule_param,
+                               double cost,
+                               size_t freq_feature_size,
+                               size_t thread_size,
+                               bool deterministic,
+                               const char *spill_file,
+                               bool online,
+                               std::ostream *os);
 }
 #endif
@@ -11,43 +11,43 @@
 #include <string>
 #include <vector>
 #include "analyzer.h"
-#include "dep.h"
 #include "common.h"
+#include "corpus_reader.h"
+#include "dep.h"
+#include "example_set.h"
 #include "freelist.h"
 #include "param.h"
 #include "scoped_ptr.h"
 #include "selector.h"
 #include "svm.h"
 #include "svm_learn.h"
+#include "thread.h"
 #include "timer.h"
 #include "tree_allocator.h"
+#include "ucs.h"
 #include "utils.h"
 
 namespace CaboCha {
-
-bool runDependencyTraining(const char *train_file,
-                           const char *model_file,
-                           const char *prev_model_file,
-                           CharsetType charset,
-                           PossetType posset,
-                           double cost,
-                           int freq) {
-  CHECK_DIE(cost > 0.0) << "cost must be positive value";
-  CHECK_DIE(freq == 1) << "freq > 1 is not supported";
-  DependencyParser *dependency_parser = new DependencyParser;
-
-  scoped_ptr<Analyzer> analyzer(dependency_parser);
-  scoped_ptr<Analyzer> selector(new Selector);
-
-  {
-    Param param;
-    progress_timer pg;
-
-    std::ifstream ifs(WPATH(train_file));
-    CHECK_DIE(ifs) << "no such file or directory: " << train_file;
-
-    scoped_ptr<Tree> tree(new Tree);
-    std::cout << "reading training data: " << std::flush;
+namespace {
+// Extracts the examples of the sentences [begin, end) of the corpus
+// with its own parser, feature dictionary and example set.
+class FeatureExtractor : public thread {
+ public:
+  const CorpusReader *reader;
+  size_t              begin;
+  size_t              end;
+  volatile int       *line;  // sentences processed by all threads
+  std::ostream       *os;    // progress, or NULL
+  DependencyParser   *dependency_parser;
+  scoped_ptr<Analyzer> analyzer;
+  scoped_ptr<Analyzer> selector;
+  scoped_ptr<Tree>     tree;
+
+  void open(CharsetType charset, PossetType posset, const Param &param) {
+    dependency_parser = new DependencyParser;
+    analyzer.reset(dependency_parser);
+    selector.reset(new Selector);
+    tree.reset(new Tree);
 
     tree->set_charset(charset);
     tree->set_posset(posset);
@@ -60,27 +60,131 @@ bool runDependencyTraining(const char *train_file,
     selector->set_charset(charset);
     selector->set_posset(posset);
     selector->set_action_mode(TRAINING_MODE);
-    selector->open(param);
-
-    size_t line = 0;
-    std::string str;
-    while (ifs) {
-      CHECK_DIE(read_sentence(&ifs, &str, INPUT_CHUNK));
-      if (str.empty()) {
-        break;
-      }
-      CHECK_DIE(tree->read(str.c_str(), str.size(),
-                          INPUT_CHUNK)) << "cannot parse sentence";
+    CHECK_DIE(selector->open(param)) << selector->what();
+  }
+
+  void run() {
+    for (size_t i = begin; i < end; ++i) {
+      CHECK_DIE(tree->read(reader->sentence(i),
+                           reader->sentence_length(i),
+                           INPUT_CHUNK)) << "cannot parse sentence";
       CHECK_DIE(selector->parse(tree.get())) << selector->what();
       CHECK_DIE(analyzer->parse(tree.get())) << analyzer->what();
-      CHECK_DIE(!tree->empty()) << "[" << str << "]";
-      if (++line % 100 == 0) {
-        std::cout << line << ".. " << std::flush;
+      CHECK_DIE(!tree->empty()) << "[" <<
+          std::string(reader->sentence(i),
+                      reader->sentence_length(i)) << "]";
+      const int n = atomic_add(line, 1);
+      if (os && n % 100 == 0) {
+        *os << n << ".. " << std::flush;
+      }
+    }
+    tree.reset(0);
+  }
+
+  FeatureExtractor()
+      : reader(0), begin(0), end(0), line(0), os(0),
+        dependency_parser(0) {}
+};
+
+// Appends the examples of |shard| to |target|. The features new to
+// |target| get the next ids in the order of the ids in |shard|, so
+// that merging the shards in the corpus order assigns the same ids
+// as a single pass over the whole corpus does.
+void mergeExamples(DependencyParser *shard, DependencyParser *target) {
+  const SVMModel *shard_model =
+      static_cast<SVMModel *>(shard->mutable_svm_model());
+  SVMModel *target_model =
+      static_cast<SVMModel *>(target->mutable_svm_model());
+  ExampleSet *shard_example = shard->mutable_example_set();
+  ExampleSet *target_example = target->mutable_example_set();
+
+  const std::map<std::string, int> &dic = shard_model->dic();
+  std::vector<const std::string *> key(dic.size());
+  for (std::map<std::string, int>::const_iterator it = dic.begin();
+       it != dic.end(); ++it) {
+    key[it->second] = &it->first;
+  }
+
+  std::vector<int> old2new(key.size());
+  for (size_t i = 0; i < key.size(); ++i) {
+    old2new[i] = target_model->id(*key[i]);
+  }
+
+  std::vector<int> x;
+  for (size_t i = 0; i < shard_example->size(); ++i) {
+    shard_example->x(i, &x);
+    for (size_t j = 0; j < x.size(); ++j) {
+      x[j] = old2new[x[j]];
+    }
+    target_example->add(shard_example->y(i), x);
+  }
+
+  shard->close();
+}
+}  // namespace
+
+SVMModel *trainDependencyModel(const char *train_file,
+                               const char *prev_model_file,
+                               CharsetType charset,
+                               PossetType posset,
+                               const Param &rule_param,
+                               double cost,
+                               size_t freq_feature_size,
+                               size_t thread_size,
+                               bool deterministic,
+                               const char *spill_file,
+                               bool online,
+                               std::ostream *os) {
+  CHECK_DIE(cost > 0.0) << "cost must be positive value";
+  CHECK_DIE(thread_size > 0) << "thread size must be positive value";
+  CHECK_DIE(!online || prev_model_file)
+      << "online update needs the old model";
+
+  CorpusReader reader;
+  CHECK_DIE(reader.open(train_file, INPUT_CHUNK)) << reader.what();
+
+  // The sentences are split into |thread_size| shards, whose examples
+  // are merged into the first one in order.
+  scoped_array<FeatureExtractor> extractor(
+      new FeatureExtractor[thread_size]);
+  {
+    progress_timer pg(*os);
+    *os << "reading training data: " << std::flush;
+
+    std::vector<size_t> range;
+    reader.split(thread_size, &range);
+    volatile int line = 0;
+    for (size_t k = 0; k < thread_size; ++k) {
+      extractor[k].reader = &reader;
+      extractor[k].begin = range[k];
+      extractor[k].end = range[k + 1];
+      extractor[k].line = &line;
+      extractor[k].os = (k == 0) ? os : 0;
+      extractor[k].open(charset, posset, rule_param);
+    }
+
+    if (thread_size == 1) {
+      extractor[0].run();
+    } else {
+      for (size_t k = 0; k < thread_size; ++k) {
+        extractor[k].start();
+      }
+      for (size_t k = 0; k < thread_size; ++k) {
+        extractor[k].join();
       }
     }
-    std::cout << "\nDone! ";
+
+    for (size_t k = 1; k < thread_size; ++k) {
+      mergeExamples(extractor[k].dependency_parser,
+                    extractor[0].dependency_parser);
+    }
+
+    *os << "\nDone! ";
   }
 
+  reader.close();
+  DependencyParser *dependency_parser = extractor[0].dependency_parser;
+
   scoped_ptr<SVMModel> prev_model(new SVMModel);
   if (prev_model_file) {
     CHECK_DIE(prev_model->open(prev_model_file))
@@ -91,17 +195,53 @@ bool runDependencyTraining(const char *train_file,
       static_cast<SVMModel *>(dependency_parser->mutable_svm_model());
   CHECK_DIE(svm_example);
 
-  svm_example->sortFeatures();
-
-  scoped_ptr<SVMModel> model(SVMSolver::learn(*svm_example,
-                                              *prev_model.get(), cost));
-  CHECK_DIE(model.get());
+  ExampleSet *example_set = dependency_parser->mutable_example_set();
+  CHECK_DIE(example_set);
+
+  SVMModel *model = 0;
+  if (online) {
+    model = SVMSolver::update(svm_example->dic(), *example_set,
+                              *prev_model.get(), cost,
+                              freq_feature_size, os);
+  } else {
+    CHECK_DIE(example_set->sortFeatures(svm_example->mutable_dic()))
+        << example_set->what();
+    if (spill_file) {
+      example_set->set_spill_file(spill_file);
+    }
+    model = SVMSolver::learn(svm_example->dic(),
+                             example_set,
+                             *prev_model.get(), cost,
+                             freq_feature_size,
+                             thread_size, deterministic, os);
+  }
+  CHECK_DIE(model);
 
   model->set_param("charset", encode_charset(charset));
   model->set_param("posset",  encode_posset(posset));
   model->set_param("type", "dep");
   model->sortInstances();
 
+  return model;
+}
+
+// Writes the text model of the dependency parser to |model_file|, as
+// the original API did. cabocha-learn uses trainDependencyModel() and
+// compiles the model in memory.
+bool runDependencyTraining(const char *train_file,
+                           const char *model_file,
+                           const char *prev_model_file,
+                           CharsetType charset,
+                           PossetType posset,
+                           double cost,
+                           int freq) {
+  CHECK_DIE(freq == 1) << "freq > 1 is not supported";
+  const Param rule_param;
+  scoped_ptr<SVMModel> model(
+      trainDependencyModel(train_file, prev_model_file, charset, posset,
+                           rule_param, cost, kDefaultFreqFeatureSize,
+                           1, false, 0, false, &std::cout));
+  CHECK_DIE(model.get());
   return model->save(model_file);
 }
 }
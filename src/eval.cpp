@@ -10,6 +10,7 @@
 #include <vector>
 #include "cabocha.h"
 #include "common.h"
+#include "eval.h"
 #include "param.h"
 #include "utils.h"
 
@@ -52,6 +53,87 @@ void find_ne_chunks(const Tree &tree,
   }
 }
 
+void DependencyEval::clear() {
+  for (size_t i = 0; i < 3; ++i) {
+    all_chunk_[i] = correct_chunk_[i] = 0;
+  }
+  all_sentence_ = correct_sentence_ = 0;
+}
+
+void DependencyEval::add(const std::vector<int> &answer,
+                         const std::vector<int> &result) {
+  CHECK_DIE(answer.size() == result.size())
+      << "tree size is different";
+  if (answer.empty()) {
+    return;
+  }
+
+  const int size = static_cast<int>(answer.size());
+  bool is_all_correct = true;
+  for (int i = 0; i < size; ++i) {
+    const bool correct = (answer[i] == result[i]);
+    if (!correct) {
+      is_all_correct = false;
+    }
+    for (int level = 0; level < 3; ++level) {
+      if (i < size - level) {
+        if (correct) {
+          ++correct_chunk_[level];
+        }
+        ++all_chunk_[level];
+      }
+    }
+  }
+
+  if (is_all_correct) {
+    ++correct_sentence_;
+  }
+  ++all_sentence_;
+}
+
+void DependencyEval::merge(const DependencyEval &eval) {
+  for (size_t i = 0; i < 3; ++i) {
+    all_chunk_[i] += eval.all_chunk_[i];
+    correct_chunk_[i] += eval.correct_chunk_[i];
+  }
+  all_sentence_ += eval.all_sentence_;
+  correct_sentence_ += eval.correct_sentence_;
+}
+
+double DependencyEval::accuracy(size_t level) const {
+  CHECK_DIE(level < 3);
+  return all_chunk_[level] == 0 ? 0.0 :
+      100.0 * correct_chunk_[level] / all_chunk_[level];
+}
+
+double DependencyEval::sentence_accuracy() const {
+  return all_sentence_ == 0 ? 0.0 :
+      100.0 * correct_sentence_ / all_sentence_;
+}
+
+void DependencyEval::print(std::ostream *os) const {
+  const float p0 = accuracy(0);
+  const float p1 = accuracy(1);
+  const float p2 = accuracy(2);
+  const float s1 = sentence_accuracy();
+
+  char buf[256];
+  snprintf(buf, sizeof(buf) - 1,
+           "dependency level0: %4.4f (%d/%d)\n"
+           "dependency level1: %4.4f (%d/%d)\n"
+           "dependency level2: %4.4f (%d/%d)\n"
+           "sentence         : %4.4f (%d/%d)\n",
+           p0, static_cast<int>(correct_chunk_[0]),
+           static_cast<int>(all_chunk_[0]),
+           p1, static_cast<int>(correct_chunk_[1]),
+           static_cast<int>(all_chunk_[1]),
+           p2, static_cast<int>(correct_chunk_[2]),
+           static_cast<int>(all_chunk_[2]),
+           s1, static_cast<int>(correct_sentence_),
+           static_cast<int>(all_sentence_));
+  *os << buf;
+}
+
 class Eval {
  public:
   static bool eval(int argc, char **argv) {
@@ -319,15 +401,9 @@ class Eval {
     std::string tree_str2;
     Tree tree1;
     Tree tree2;
-
-    size_t all_chunk0 = 0;
-    size_t all_chunk1 = 0;
-    size_t all_chunk2 = 0;
-    size_t all_sentence = 0;
-    size_t correct_chunk0 = 0;
-    size_t correct_chunk1 = 0;
-    size_t correct_chunk2 = 0;
-    size_t correct_sentence = 0;
+    std::vector<int> link1;
+    std::vector<int> link2;
+    DependencyEval eval;
 
     while (ifs1 && ifs2) {
       tree_str1.clear();
@@ -345,71 +421,16 @@ class Eval {
       CHECK_DIE(tree1.chunk_size() == tree2.chunk_size())
           << "tree size is different";
 
-
-      if (tree1.chunk_size() == 0) continue;
-
-      for (int i = 0; i < static_cast<int>(tree1.chunk_size()); ++i) {
-        const Chunk *chunk1 = tree1.chunk(i);
-        const Chunk *chunk2 = tree2.chunk(i);
-        {
-          if (chunk1->link == chunk2->link) {
-            ++correct_chunk0;
-          }
-          ++all_chunk0;
-        }
-
-        if (i < static_cast<int>(tree1.chunk_size() - 1)) {
-          if (chunk1->link == chunk2->link) {
-            ++correct_chunk1;
-          }
-          ++all_chunk1;
-        }
-
-        if (i < static_cast<int>(tree1.chunk_size() - 2)) {
-          if (chunk1->link == chunk2->link) {
-            ++correct_chunk2;
-          }
-          ++all_chunk2;
-        }
-      }
-
-      bool is_all_correct = true;
+      link1.clear();
+      link2.clear();
       for (size_t i = 0; i < tree1.chunk_size(); ++i) {
-        if (tree1.chunk(i)->link != tree2.chunk(i)->link) {
-          is_all_correct = false;
-          break;
-        }
+        link1.push_back(tree1.chunk(i)->link);
+        link2.push_back(tree2.chunk(i)->link);
       }
-      if (is_all_correct) {
-        ++correct_sentence;
-      }
-      ++all_sentence;
+      eval.add(link1, link2);
     }
 
-    const float p0 = all_chunk0 == 0 ? 0.0 :
-        100.0 * correct_chunk0 / all_chunk0;
-    const float p1 = all_chunk1 == 0 ? 0.0 :
-        100.0 * correct_chunk1 / all_chunk1;
-    const float p2 = all_chunk2 == 0 ? 0.0 :
-        100.0 * correct_chunk2 / all_chunk2;
-    const float s1 = all_sentence == 0 ? 0.0 :
-        100.0 * correct_sentence / all_sentence;
-
-    char buf[256];
-    snprintf(buf, sizeof(buf) - 1,
-             "dependency level0: %4.4f (%d/%d)\n"
-             "dependency level1: %4.4f (%d/%d)\n"
-             "dependency level2: %4.4f (%d/%d)\n"
-             "sentence         : %4.4f (%d/%d)\n",
-             p0, static_cast<int>(correct_chunk0),
-             static_cast<int>(all_chunk0),
-             p1, static_cast<int>(correct_chunk1),
-             static_cast<int>(all_chunk1),
-             p2, static_cast<int>(correct_chunk2),
-             static_cast<int>(all_chunk2),
-             s1, static_cast<int>(correct_sentence),
-             static_cast<int>(all_sentence));
-    std::cout << buf;
+    eval.print(&std::cout);
 
     return true;
   }
@@ -0,0 +1,34 @@
+// CaboCha -- Yet Another Japanese Dependency Parser
+#ifndef CABOCHA_EVAL_H_
+#define CABOCHA_EVAL_H_
+
+#include <iostream>
+#include <vector>
+#include "common.h"
+
+namespace CaboCha {
+
+// Counts the correct links of the dependency parser. Level n only
+// counts the chunks which have at least n chunks on their right.
+class DependencyEval {
+ public:
+  // Adds a sentence, given the links of the answer and the result.
+  void add(const std::vector<int> &answer, const std::vector<int> &result);
+  void merge(const DependencyEval &eval);
+  void clear();
+
+  double accuracy(size_t level) const;
+  double sentence_accuracy() const;
+
+  void print(std::ostream *os) const;
+
+  DependencyEval() { clear(); }
+
+ private:
+  size_t all_chunk_[3];
+  size_t correct_chunk_[3];
+  size_t all_sentence_;
+  size_t correct_sentence_;
+};
+}
+#endif
@@ -0,0 +1,159 @@
+// CaboCha -- Yet Another Japanese Dependency Parser
+#include <algorithm>
+#include <fstream>
+#include <functional>
+#include "example_set.h"
+#include "utils.h"
+
+namespace CaboCha {
+namespace {
+void encode(unsigned int value, std::vector<unsigned char> *output) {
+  while (value >= 0x80) {
+    output->push_back(static_cast<unsigned char>(value | 0x80));
+    value >>= 7;
+  }
+  output->push_back(static_cast<unsigned char>(value));
+}
+
+void decode(const unsigned char *begin, const unsigned char *end,
+            std::vector<int> *x) {
+  x->clear();
+  unsigned int prev = 0;
+  while (begin < end) {
+    unsigned int value = 0;
+    for (int shift = 0; ; shift += 7) {
+      const unsigned char c = *begin++;
+      value |= static_cast<unsigned int>(c & 0x7f) << shift;
+      if (!(c & 0x80)) {
+        break;
+      }
+    }
+    prev += value;
+    x->push_back(static_cast<int>(prev));
+  }
+}
+
+void encode(const std::vector<int> &x, std::vector<unsigned char> *output) {
+  unsigned int prev = 0;
+  for (size_t i = 0; i < x.size(); ++i) {
+    encode(static_cast<unsigned int>(x[i]) - prev, output);
+    prev = static_cast<unsigned int>(x[i]);
+  }
+}
+}  // namespace
+
+ExampleSet::ExampleSet() : spilled_(false) {}
+
+ExampleSet::~ExampleSet() {
+  clear();
+}
+
+void ExampleSet::clear() {
+  mmap_.close();
+  if (spilled_) {
+    Unlink(spill_file_.c_str());
+  }
+  spilled_ = false;
+  std::vector<unsigned char>().swap(arena_);
+  std::vector<size_t>().swap(offset_);
+  std::vector<signed char>().swap(y_);
+}
+
+void ExampleSet::add(int y, const std::vector<int> &x) {
+  CHECK_DIE(!spilled_) << "examples are already spilled";
+  std::vector<int> tmp(x);
+  std::sort(tmp.begin(), tmp.end());
+  if (offset_.empty()) {
+    offset_.push_back(0);
+  }
+  encode(tmp, &arena_);
+  offset_.push_back(arena_.size());
+  y_.push_back(y > 0 ? +1 : -1);
+}
+
+void ExampleSet::x(size_t i, std::vector<int> *x) const {
+  decode(data() + offset_[i], data() + offset_[i + 1], x);
+}
+
+bool ExampleSet::sortFeatures(std::map<std::string, int> *dic) {
+  CHECK_FALSE(!spilled_) << "examples are already spilled";
+
+  std::vector<int> x;
+  int max_id = 0;
+  for (size_t i = 0; i < size(); ++i) {
+    this->x(i, &x);
+    if (!x.empty()) {
+      max_id = std::max(max_id, x.back());
+    }
+  }
+
+  std::vector<std::pair<int, int> > freq(max_id + 1);
+  for (size_t i = 0; i < size(); ++i) {
+    this->x(i, &x);
+    for (size_t j = 0; j < x.size(); ++j) {
+      freq[x[j]].first++;
+      freq[x[j]].second = x[j];
+    }
+  }
+
+  // sort by freq. if freq is the same, keep the original
+  // order as much as possible.
+  std::stable_sort(freq.begin(), freq.end(),
+                   std::greater<std::pair<int, int> >());
+
+  std::vector<int> old2new(freq.size(), -1);
+  for (size_t i = 0; i < freq.size(); ++i) {
+    old2new[freq[i].second] = i;
+  }
+
+  for (size_t i = 0; i < old2new.size(); ++i) {
+    CHECK_FALSE(old2new[i] >= 0);
+  }
+
+  for (std::map<std::string, int>::iterator it = dic->begin();
+       it != dic->end(); ++it) {
+    CHECK_FALSE(it->second <= max_id) << "unused feature: " << it->first;
+    it->second = old2new[it->second];
+  }
+
+  std::vector<unsigned char> arena;
+  arena.reserve(arena_.size());
+  for (size_t i = 0; i < size(); ++i) {
+    this->x(i, &x);
+    for (size_t j = 0; j < x.size(); ++j) {
+      x[j] = old2new[x[j]];
+    }
+    std::sort(x.begin(), x.end());
+    offset_[i] = arena.size();
+    encode(x, &arena);
+  }
+  if (!offset_.empty()) {
+    offset_.back() = arena.size();
+  }
+  arena_.swap(arena);
+
+  return true;
+}
+
+bool ExampleSet::spill() {
+  if (spill_file_.empty() || spilled_ || arena_.empty()) {
+    return true;
+  }
+
+  {
+    std::ofstream ofs(WPATH(spill_file_.c_str()),
+                      std::ios::binary|std::ios::out);
+    CHECK_FALSE(ofs) << "permission denied: " << spill_file_;
+    ofs.write(reinterpret_cast<const char *>(&arena_[0]), arena_.size());
+    CHECK_FALSE(ofs) << "write() failed: " << spill_file_;
+  }
+
+  spilled_ = true;
+  CHECK_FALSE(mmap_.open(spill_file_.c_str())) << mmap_.what();
+  CHECK_FALSE(mmap_.file_size() == arena_.size())
+      << "broken file: " << spill_file_;
+  std::vector<unsigned char>().swap(arena_);
+
+  return true;
+}
+}
@@ -0,0 +1,64 @@
+// CaboCha -- Yet Another Japanese Dependency Parser
+#ifndef CABOCHA_EXAMPLE_SET_H_
+#define CABOCHA_EXAMPLE_SET_H_
+
+#include <map>
+#include <string>
+#include <vector>
+#include "common.h"
+#include "mmap.h"
+
+namespace CaboCha {
+
+// Training examples of the SVM, stored once in a CSR arena: the
+// feature ids of an example are sorted and the differences between
+// them are written in variable-length bytes. Optionally, the arena
+// is moved into a file and mmap()ed, so that it can be paged out.
+class ExampleSet {
+ public:
+  // Adds an example of the label |y| (+1/-1).
+  void add(int y, const std::vector<int> &x);
+
+  size_t size() const { return y_.size(); }
+  int y(size_t i) const { return y_[i]; }
+
+  // Decodes the features of the i-th example in ascending order.
+  void x(size_t i, std::vector<int> *x) const;
+
+  // Renumbers the features in descending order of frequency, as
+  // SVMModel::sortFeatures() does, and the ids in |dic| as well.
+  bool sortFeatures(std::map<std::string, int> *dic);
+
+  // Moves the arena into |filename| in spill(). No example can be
+  // added after that. The file is removed in clear().
+  void set_spill_file(const char *filename) { spill_file_ = filename; }
+  bool spill();
+
+  size_t arena_size() const {
+    return offset_.empty() ? 0 : offset_.back();
+  }
+
+  void clear();
+  const char *what() { return what_.str(); }
+
+  ExampleSet();
+  virtual ~ExampleSet();
+
+ private:
+  const unsigned char *data() const {
+    if (spilled_) {
+      return reinterpret_cast<const unsigned char *>(mmap_.begin());
+    }
+    return arena_.empty() ? 0 : &arena_[0];
+  }
+
+  std::vector<unsigned char> arena_;
+  std::vector<size_t>        offset_;  // [i, i + 1) is the i-th example
+  std::vector<signed char>   y_;
+  Mmap<char>                 mmap_;
+  std::string                spill_file_;
+  bool                       spilled_;
+  whatlog                    what_;
+};
+}
+#endif
@@ -0,0 +1,70 @@
+// CaboCha -- Yet Another Japanese Dependency Parser
+#include <crfpp.h>
+#include "cabocha.h"
+#include "chunker.h"
+#include "common.h"
+#include "joint_tagger.h"
+#include "ne.h"
+#include "token_cache.h"
+#include "tree_allocator.h"
+
+namespace CaboCha {
+namespace {
+const size_t kColumnSize = 5;
+}
+
+JointTagger::JointTagger() {}
+JointTagger::~JointTagger() { close(); }
+
+bool JointTagger::open(const Param &param) {
+  close();
+
+  ne_.reset(new NE);
+  chunker_.reset(new Chunker);
+  Analyzer *analyzer[] = { ne_.get(), chunker_.get() };
+  for (size_t i = 0; i < 2; ++i) {
+    analyzer[i]->set_action_mode(action_mode());
+    analyzer[i]->set_charset(charset());
+    analyzer[i]->set_posset(posset());
+    CHECK_FALSE(analyzer[i]->open(param)) << analyzer[i]->what();
+  }
+
+  return true;
+}
+
+void JointTagger::close() {
+  ne_.reset(0);
+  chunker_.reset(0);
+}
+
+bool JointTagger::parse(Tree *tree) const {
+  TreeAllocator *allocator = tree->allocator();
+  CHECK_TREE_FALSE(allocator);
+  CHECK_TREE_FALSE(ne_.get() && chunker_.get());
+
+  const size_t size = tree->token_size();
+  TokenCache *cache = allocator->mutable_token_cache();
+  allocator->feature.resize(size * kColumnSize);
+  for (size_t i = 0; i < size; ++i) {
+    const Token *token = tree->token(i);
+    TokenInfo *info = cache->find(token, tree->charset(), tree->posset());
+    const char *pos = cache->pos(token, info);
+    const char **column = &allocator->feature[i * kColumnSize];
+    column[0] = token->normalized_surface;
+    column[1] = pos;
+    column[2] = token->normalized_surface;
+    column[3] = ne_->char_feature(token, info, cache);
+    column[4] = pos;
+  }
+
+  const char **x = size ? &allocator->feature[0] : 0;
+
+  // The chunker goes first, as the NE tagger may move the rows.
+  CHECK_TREE_FALSE(chunker_->tag(tree, x, kColumnSize));
+  if (!ne_->skip(tree)) {
+    CHECK_TREE_FALSE(ne_->tag(tree, x ? x + 2 : 0, kColumnSize));
+  }
+
+  return true;
+}
+}
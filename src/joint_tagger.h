@@ -0,0 +1,31 @@
+// CaboCha -- Yet Another Japanese Dependency Parser
+#ifndef CABOCHA_JOINT_TAGGER_H_
+#define CABOCHA_JOINT_TAGGER_H_
+
+#include "analyzer.h"
+#include "scoped_ptr.h"
+
+namespace CaboCha {
+
+class Chunker;
+class NE;
+
+// Runs the NE tagger and the chunker over one feature extraction
+// pass. The columns of a token are built once and laid out as
+// (surface, POS, surface, char feature, POS), so that the chunker
+// reads the first two and the NE tagger the last three.
+class JointTagger : public Analyzer {
+ public:
+  bool open(const Param &param);
+  void close();
+  bool parse(Tree *tree) const;
+
+  explicit JointTagger();
+  virtual ~JointTagger();
+
+ private:
+  scoped_ptr<NE>      ne_;
+  scoped_ptr<Chunker> chunker_;
+};
+}
+#endif
@@ -8,8 +8,12 @@
 #include <vector>
 #include <fstream>
 #include "cabocha.h"
+#include "chunker.h"
 #include "param.h"
 #include "common.h"
+#include "dep.h"
+#include "scoped_ptr.h"
+#include "selector.h"
 #include "utils.h"
 #include "ucs.h"
 #include "svm.h"
@@ -81,6 +85,8 @@ int cabocha_model_index(int argc, char **argv) {
       CABOCHA_DEFAULT_CHARSET ")" },
     {"freq-feature-size", 'F', "3000", "INT",
      "size of frequent features (default 3000)" },
+    {"threads",  'p', "1",      "INT",
+     "number of threads (default 1)" },
     {"version",  'v', 0,        0,       "show the version and exit" },
     {"help",     'h', 0,        0,       "show this help and exit" },
     {0, 0, 0, 0, 0}
@@ -112,12 +118,15 @@ int cabocha_model_index(int argc, char **argv) {
   if (type == TRAIN_DEP) {
     const double sigma = param.get<double>("sigma");
     const size_t minsup = param.get<size_t>("minsup");
+    const size_t thread_size = param.get<size_t>("threads");
     CHECK_DIE(CaboCha::FastSVMModel::compile(input.c_str(),
                                              rest[1].c_str(),
                                              sigma,
                                              minsup,
                                              freq_feature_size,
-                                             &iconv));
+                                             thread_size,
+                                             &iconv,
+                                             &std::cout));
   } else if (type == TRAIN_NE) {
     std::string tmp_input = convert_character_encoding(input.c_str(),
                                                        &iconv);
@@ -153,6 +162,18 @@ int cabocha_learn(int argc, char **argv) {
      "size of frequent features (default 3000)" },
     {"old-model", 'M', 0, "FILE",
      "set FILE as old SVM model file" },
+    {"threads",  'p', "1",      "INT",
+     "number of threads (default 1)" },
+    {"deterministic", 'd', 0,  0,
+     "make the result independent of the timing of threads (slower)" },
+    {"spill",    'S', 0,        0,
+     "keep the training examples in a temporary file during training" },
+    {"text-model", 'T', 0,      0,
+     "also write the text model to OUTPUT.txt, usable with -M" },
+    {"online",   'o', 0,        0,
+     "update the old model (-M) online instead of retraining" },
+    {"rcfile",   'r', 0,        "FILE",
+     "use the head-rule and func-rule of FILE (dep only)" },
     { "charset",   't',  CABOCHA_DEFAULT_CHARSET, "ENC",
       "set parser charset to ENC (default "
       CABOCHA_DEFAULT_CHARSET ")" },
@@ -192,42 +213,65 @@ int cabocha_learn(int argc, char **argv) {
   const int    freq   = param.get<int>("freq");
   const float  sigma  = param.get<float>("sigma");
   const size_t minsup = param.get<size_t>("minsup");
+  const size_t thread_size = param.get<size_t>("threads");
+  const bool deterministic = param.get<bool>("deterministic");
+  const bool spill = param.get<bool>("spill");
+  const bool text_model = param.get<bool>("text-model");
+  const bool online = param.get<bool>("online");
 
   if (type == TRAIN_DEP) {
-    const std::string text_model_file = rest[1] + ".txt";
-    CHECK_DIE(CaboCha::runDependencyTraining(
-                  rest[0].c_str(),
-                  text_model_file.c_str(),
-                  old_model_file.empty() ? 0 : old_model_file.c_str(),
-                  charset,
-                  posset,
-                  cost, freq));
+    CHECK_DIE(freq == 1) << "freq > 1 is not supported";
+    CaboCha::Param rule_param;
+    const std::string rcfile = param.get<std::string>("rcfile");
+    if (!rcfile.empty()) {
+      CHECK_DIE(CaboCha::load_selector_rules(rcfile.c_str(), &rule_param))
+          << "no such file or directory: " << rcfile;
+    }
+    const std::string spill_file = rest[1] + ".examples";
+    CaboCha::scoped_ptr<CaboCha::SVMModel> model(
+        CaboCha::trainDependencyModel(
+            rest[0].c_str(),
+            old_model_file.empty() ? 0 : old_model_file.c_str(),
+            charset, posset, rule_param, cost, freq_feature_size,
+            thread_size, deterministic,
+            spill ? spill_file.c_str() : 0, online, &std::cout));
+    CHECK_DIE(model.get());
+
+    // The text model is only needed as an old model (-M) of the next
+    // training, and the binary model is compiled from memory.
+    if (text_model) {
+      const std::string text_model_file = rest[1] + ".txt";
+      CHECK_DIE(model->save(text_model_file.c_str()));
+    }
+
     CaboCha::Iconv iconv;
-    iconv.open(charset, charset);
-    CHECK_DIE(CaboCha::FastSVMModel::compile(text_model_file.c_str(),
-                                             rest[1].c_str(),
-                                             sigma,
-                                             minsup,
-                                             freq_feature_size, &iconv));
+    CHECK_DIE(iconv.open(charset, charset));
+    CHECK_DIE(CaboCha::FastSVMModel::compile(model.get(), rest[1].c_str(),
+                                             sigma, minsup,
+                                             freq_feature_size,
+                                             thread_size, &iconv,
+                                             &std::cout));
   } else if (type == TRAIN_CHUNK || type == TRAIN_NE) {
     CHECK_DIE(old_model_file.empty())
         << "old-model is not supported in CHUNK|NE mode";
     if (type == TRAIN_CHUNK) {
-      CHECK_DIE(CaboCha::runChunkingTraining(
+      CHECK_DIE(CaboCha::runChunkingTrainingWithCRFPP(
+                    CaboCha::TRAIN_CHUNK,
                     rest[0].c_str(),
                     rest[1].c_str(),
                     old_model_file.empty() ? 0 : old_model_file.c_str(),
                     charset,
                     posset,
-                    cost, freq));
+                    cost, freq, thread_size));
     } else if (type == TRAIN_NE) {
-      CHECK_DIE(CaboCha::runNETraining(
+      CHECK_DIE(CaboCha::runChunkingTrainingWithCRFPP(
+                    CaboCha::TRAIN_NE,
                     rest[0].c_str(),
                     rest[1].c_str(),
                     old_model_file.empty() ? 0 : old_model_file.c_str(),
                     charset,
                     posset,
-                    cost, freq));
+                    cost, freq, thread_size));
     }
   }
 
@@ -206,9 +206,11 @@ bool MorphAnalyzer::parse(Tree *tree) const {
     CHECK_TREE_FALSE(allocator->mecab_lattice);
   }
 
-  mecab_lattice_add_request_type_f(
-      allocator->mecab_lattice,
-      MECAB_ALLOCATE_SENTENCE);
+  if (!allocator->borrow_mecab_node) {
+    mecab_lattice_add_request_type_f(
+        allocator->mecab_lattice,
+        MECAB_ALLOCATE_SENTENCE);
+  }
   mecab_lattice_set_sentence2_f(
       allocator->mecab_lattice,
       tree->sentence(),
@@ -5,13 +5,17 @@
 //  Copyright(C) 2001-2008 Taku Kudo <taku@chasen.org>
 #include <crfpp.h>
 #include <cstdio>
+#include <cstring>
 #include <iterator>
 #include <string>
 #include <vector>
 #include "cabocha.h"
 #include "char_category.h"
+#include "crf.h"
 #include "ne.h"
 #include "param.h"
+#include "selector.h"
+#include "token_cache.h"
 #include "tree_allocator.h"
 #include "ucs.h"
 #include "utils.h"
@@ -32,7 +36,7 @@ int get_char_class(int charset,
     case UTF8:   c = utf8_to_ucs2(begin, end, mblen); break;
     default:     c = utf8_to_ucs2(begin, end, mblen); break;
   }
-  return char_category[c];
+  return char_category(c);
 }
 
 void get_char_feature(int charset, const char *str, char *feature) {
@@ -76,27 +80,107 @@ void get_char_feature(int charset, const char *str, char *feature) {
 }
 } // end of anonmyous
 
-NE::NE(): model_(0) {}
+NE::NE(): model_(0), outside_(-1) {}
 NE::~NE() { close(); }
 
+int NE::intern(const std::string &name) {
+  for (size_t i = 0; i < labels_.size(); ++i) {
+    if (labels_[i].name == name) {
+      return static_cast<int>(i);
+    }
+  }
+  Label label;
+  label.name = name;
+  label.begin = label.inside = -1;
+  label.type = -1;
+  if (name.size() >= 3) {
+    const std::string type = name.substr(3);
+    for (size_t i = 0; i < types_.size(); ++i) {
+      if (types_[i] == type) {
+        label.type = static_cast<int>(i);
+        break;
+      }
+    }
+    if (label.type == -1) {
+      label.type = static_cast<int>(types_.size());
+      types_.push_back(type);
+    }
+  }
+  labels_.push_back(label);
+  return static_cast<int>(labels_.size() - 1);
+}
+
+bool NE::add_labels(const std::vector<std::string> &names) {
+  labels_.clear();
+  types_.clear();
+  y_labels_.clear();
+  for (size_t i = 0; i < names.size(); ++i) {
+    CHECK_FALSE(!names[i].empty()) << "empty NE label";
+    y_labels_.push_back(intern(names[i]));
+  }
+  outside_ = intern("O");
+  // The B-/I- counterparts are interned as well, so that the tags
+  // rewritten in parse() are also shared strings.
+  for (size_t i = 0; i < labels_.size(); ++i) {
+    std::string name = labels_[i].name;
+    name[0] = 'B';
+    const int begin = intern(name);
+    name[0] = 'I';
+    const int inside = intern(name);
+    labels_[i].begin = begin;
+    labels_[i].inside = inside;
+  }
+  return true;
+}
+
 bool NE::open(const Param &param) {
   close();
 
   if (action_mode() == PARSING_MODE) {
     const std::string filename = param.get<std::string>("ne-model");
-    std::vector<const char*> argv;
-    argv.push_back(param.program_name());
-    argv.push_back("-m");
-    argv.push_back(filename.c_str());
-    model_ = crfpp_model_new(argv.size(),
-                              const_cast<char **>(&argv[0]));
-    // CHECK_FALSE(tagger_) << crfpp_strerror(tagger_);
-    // CHECK_FALSE(crfpp_ysize(tagger_) >= 2);
-    // CHECK_FALSE(crfpp_xsize(tagger_) == 3);
-    // for (size_t i = 0; i < crfpp_ysize(tagger_); ++i) {
-    //   const char *p = crfpp_yname(tagger_, i);
-    //   CHECK_FALSE(p && (p[0] == 'B' || p[0] == 'I' || p[0] == 'O'));
-    // }
+    std::vector<std::string> names;
+
+    // Uses the native decoder when the model is in the binary format
+    // of CRF++. Otherwise, leaves it to CRF++.
+    crf_model_.reset(new CRFModel);
+    if (crf_model_->open(filename.c_str()) &&
+        crf_model_->xsize() <= 3) {
+      for (size_t i = 0; i < crf_model_->ysize(); ++i) {
+        names.push_back(crf_model_->yname(i));
+      }
+    } else {
+      crf_model_.reset(0);
+      std::vector<const char*> argv;
+      argv.push_back(param.program_name());
+      argv.push_back("-m");
+      argv.push_back(filename.c_str());
+      model_ = crfpp_model_new(argv.size(),
+                               const_cast<char **>(&argv[0]));
+      if (model_) {
+        crfpp_t *tagger = crfpp_model_new_tagger(model_);
+        CHECK_FALSE(tagger);
+        for (size_t i = 0; i < crfpp_ysize(tagger); ++i) {
+          names.push_back(crfpp_yname(tagger, i));
+        }
+        crfpp_destroy(tagger);
+      }
+    }
+    CHECK_FALSE(add_labels(names));
+
+    std::string rule = param.get<std::string>("ne-rule");
+    if (!rule.empty()) {
+      Iconv iconv;
+      iconv.open(UTF8, charset());
+      CHECK_FALSE(iconv.convert(&rule))
+          << "cannot convert ne-rule: " << rule;
+      TokenRuleSet rules;
+      CHECK_FALSE(rules.parse(rule.c_str()))
+          << "ne-rule: " << rules.what();
+      matcher_.reset(new PatternMatcher);
+      CHECK_FALSE(matcher_->add_rule(rules, 0) && matcher_->build())
+          << "cannot compile ne-rule: " << rule << ": "
+          << matcher_->what();
+    }
   }
 
   // "名詞,数,"
@@ -119,18 +203,95 @@ bool NE::open(const Param &param) {
 }
 
 void NE::close() {
+  crf_model_.reset(0);
   crfpp_model_destroy(model_);
   model_ = 0;
+  labels_.clear();
+  types_.clear();
+  y_labels_.clear();
+  outside_ = -1;
+  matcher_.reset(0);
   ne_composite_ipa_.clear();
   ne_composite_juman_.clear();
   ne_composite_unidic_.clear();
 }
 
+const char *NE::char_feature(const Token *token, TokenInfo *info,
+                             TokenCache *cache) const {
+  if (!(info->flags & TokenInfo::CHAR_FEATURE)) {
+    char char_feature[16];
+    get_char_feature(charset(), token->normalized_surface, char_feature);
+    info->char_feature = cache->strdup(char_feature);
+    info->flags |= TokenInfo::CHAR_FEATURE;
+  }
+  return info->char_feature;
+}
+
+bool NE::skip(Tree *tree) const {
+  TreeAllocator *allocator = tree->allocator();
+  if (action_mode() != PARSING_MODE || !allocator) {
+    return false;
+  }
+
+  ++allocator->ne_sentence_size;
+  if (!matcher_.get()) {
+    return false;
+  }
+
+  const size_t size = tree->token_size();
+  TokenCache *cache = allocator->mutable_token_cache();
+  for (size_t i = 0; i < size; ++i) {
+    const Token *token = tree->token(i);
+    TokenInfo *info = cache->find(token, tree->charset(), tree->posset());
+    if (!(info->flags & TokenInfo::NE_CANDIDATE) ||
+        info->ne_generation != matcher_->generation()) {
+      info->ne_candidate = (matcher_->classify(*token) != 0);
+      info->ne_generation = matcher_->generation();
+      info->flags |= TokenInfo::NE_CANDIDATE;
+    }
+    if (info->ne_candidate) {
+      return false;
+    }
+  }
+
+  const char *outside = labels_[outside_].name.c_str();
+  for (size_t i = 0; i < size; ++i) {
+    tree->mutable_token(i)->ne = outside;
+  }
+  ++allocator->ne_skip_size;
+
+  return true;
+}
+
 bool NE::parse(Tree *tree) const {
   TreeAllocator *allocator = tree->allocator();
   CHECK_TREE_FALSE(allocator);
 
-  if (action_mode() == PARSING_MODE) {
+  if (skip(tree)) {
+    return true;
+  }
+
+  // three columns (surface, char feature, POS) per token
+  const size_t size  = tree->token_size();
+  TokenCache *cache = allocator->mutable_token_cache();
+  allocator->feature.clear();
+  for (size_t i = 0; i < size; ++i) {
+    const Token *token = tree->token(i);
+    TokenInfo *info = cache->find(token, tree->charset(), tree->posset());
+    allocator->feature.push_back(token->normalized_surface);
+    allocator->feature.push_back(char_feature(token, info, cache));
+    allocator->feature.push_back(cache->pos(token, info));
+  }
+
+  return tag(tree, size ? &allocator->feature[0] : 0, 3);
+}
+
+bool NE::tag(Tree *tree, const char **x, size_t column_size) const {
+  TreeAllocator *allocator = tree->allocator();
+  CHECK_TREE_FALSE(allocator);
+
+  const bool parsing = (action_mode() == PARSING_MODE);
+  if (parsing && !crf_model_.get()) {
     CHECK_TREE_FALSE(model_);
     if (!allocator->crfpp_ne) {
       allocator->crfpp_ne = crfpp_model_new_tagger(model_);
@@ -140,29 +301,30 @@ bool NE::parse(Tree *tree) const {
     crfpp_clear(allocator->crfpp_ne);
   }
 
-  std::string ne_composite;
+  const std::string *ne_composite = 0;
   switch (tree->posset()) {
     case IPA:
-      ne_composite = ne_composite_ipa_;
+      ne_composite = &ne_composite_ipa_;
       break;
     case JUMAN:
-      ne_composite = ne_composite_juman_;
+      ne_composite = &ne_composite_juman_;
       break;
     case UNIDIC:
-      ne_composite = ne_composite_unidic_;
+      ne_composite = &ne_composite_unidic_;
       break;
     default:
       CHECK_TREE_FALSE(false) << "unknown posset";
   }
 
+  // The second and later tokens of a composite numeral are not
+  // tagged. The rows of the other tokens are packed to the front.
   int comp = 0;
+  size_t x_size = 0;
   const size_t size  = tree->token_size();
-  std::string tmp;
   for (size_t i = 0; i < size; ++i) {
     const Token *token = tree->token(i);
-    const char *surface = token->normalized_surface;
-    const char *feature = token->feature;
-    if (std::string(feature).find(ne_composite) == 0) {
+    if (std::strncmp(token->feature, ne_composite->data(),
+                     ne_composite->size()) == 0) {
       ++comp;
     } else {
       comp = 0;
@@ -170,75 +332,76 @@ bool NE::parse(Tree *tree) const {
 
     if (comp >= 2) continue;
 
-    char *char_feature = tree->alloc(16);
-    get_char_feature(charset(), surface, char_feature);
-    if (tree->posset() == IPA || tree->posset() == UNIDIC) {
-      concat_feature(token, 4, &tmp);
-    } else if (tree->posset() == JUMAN) {
-      concat_feature(token, 2, &tmp);
-    }
-    const char *pos = tree->strdup(tmp.c_str());
-    allocator->feature.clear();
-    allocator->feature.push_back(surface);
-    allocator->feature.push_back(char_feature);
-    allocator->feature.push_back(pos);
-
-    const char *ne = token->ne;
-    if (action_mode() == PARSING_MODE) {
-      if (ne) {
-        allocator->feature.push_back(ne);
-      }
-      crfpp_add2(allocator->crfpp_ne,
-                 allocator->feature.size(),
-                 (const char **)&allocator->feature[0]);
-    } else {
-      CHECK_TREE_FALSE(ne) << "named entity is not defined";
-      std::copy(allocator->feature.begin(), allocator->feature.end(),
+    const char **column = x + x_size * column_size;
+    if (x_size != i) {
+      std::copy(x + i * column_size, x + i * column_size + 3, column);
+    }
+    ++x_size;
+
+    if (!parsing) {
+      CHECK_TREE_FALSE(token->ne) << "named entity is not defined";
+      std::copy(column, column + 3,
                 std::ostream_iterator<const char*>(
                     *(allocator->stream()), " "));
-      *(allocator->stream()) << ne << std::endl;
+      *(allocator->stream()) << token->ne << std::endl;
+    } else if (!crf_model_.get()) {
+      const char *columns[4];
+      std::copy(column, column + 3, columns);
+      columns[3] = token->ne;
+      crfpp_add2(allocator->crfpp_ne, token->ne ? 4 : 3, columns);
     }
   }
 
-  if (action_mode() == PARSING_MODE) {
+  if (!parsing) {
+    *(allocator->stream()) << std::endl;
+    return true;
+  }
+
+  const CRFLattice *lattice = 0;
+  if (crf_model_.get()) {
+    if (!allocator->crf_lattice) {
+      allocator->crf_lattice = new CRFLattice;
+    }
+    crf_model_->parse(x, x_size, column_size, allocator->crf_lattice);
+    lattice = allocator->crf_lattice;
+  } else {
     CHECK_TREE_FALSE(crfpp_parse(allocator->crfpp_ne));
-    const char *prev = 0;
-    size_t      ci   = 0;
-    int         comp = 0;
-
-    for (size_t i = 0; i < size; ++i) {
-      Token *token = tree->mutable_token(i);
-      if (std::string(token->feature).find(ne_composite) == 0) {
-        ++comp;
-      } else {
-        comp = 0;
-      }
+  }
 
-      if (comp >= 2) {
-        char *ne = tree->strdup(prev);
-        if (ne[0] != 'O') {
-          ne[0] = 'I';
-        }
-        token->ne = ne;
-      } else {
-        token->ne = tree->strdup(crfpp_y2(allocator->crfpp_ne,
-                                          ci));
-        ++ci;
-      }
+  int    prev = -1;
+  size_t ci   = 0;
+  comp = 0;
 
-      if ((prev && prev[0] == 'I' &&
-           token->ne[0] == 'I' && std::strlen(token->ne) >= 3 &&
-           std::strlen(prev) >= 3 && std::strcmp(token->ne + 3, prev + 3)) ||
-          (i == 0 && token->ne[0] == 'I')) {
-        char *ne = tree->strdup(token->ne);
-        ne[0] = 'B';
-        token->ne = ne;
-      }
+  for (size_t i = 0; i < size; ++i) {
+    Token *token = tree->mutable_token(i);
+    if (std::strncmp(token->feature, ne_composite->data(),
+                     ne_composite->size()) == 0) {
+      ++comp;
+    } else {
+      comp = 0;
+    }
+
+    int id = 0;
+    if (comp >= 2) {
+      id = labels_[prev].name[0] == 'O' ? prev : labels_[prev].inside;
+    } else {
+      const size_t y = lattice ? lattice->result[ci] :
+          crfpp_y(allocator->crfpp_ne, ci);
+      CHECK_TREE_FALSE(y < y_labels_.size()) << "unknown NE label";
+      id = y_labels_[y];
+      ++ci;
+    }
 
-      prev = token->ne;
+    if (labels_[id].name[0] == 'I' &&
+        (i == 0 ||
+         (labels_[prev].name[0] == 'I' &&
+          labels_[id].type >= 0 && labels_[prev].type >= 0 &&
+          labels_[id].type != labels_[prev].type))) {
+      id = labels_[id].begin;
     }
-  } else {
-    *(allocator->stream()) << std::endl;
+
+    token->ne = labels_[id].name.c_str();
+    prev = id;
   }
 
   return true;
@@ -7,24 +7,62 @@
 #define CABOCHA_NE_H_
 
 #include <string>
+#include <vector>
 #include "cabocha.h"
 #include "analyzer.h"
+#include "scoped_ptr.h"
 
 struct crfpp_t;
 
 namespace CaboCha {
 
+class CRFModel;
+class PatternMatcher;
+class TokenCache;
+struct TokenInfo;
+
 class NE : public Analyzer {
  public:
   bool open(const Param &param);
   bool parse(Tree *tree) const;
   void close();
 
+  // Tags the tokens with the columns (surface, char feature, POS) of
+  // the i-th token at x[i * column_size]. The rows after a composite
+  // numeral may be moved forward.
+  bool tag(Tree *tree, const char **x, size_t column_size) const;
+
+  const char *char_feature(const Token *token, TokenInfo *info,
+                           TokenCache *cache) const;
+
+  // Tags every token with "O" and returns true when ne-rule is given
+  // and no token of the sentence matches it.
+  bool skip(Tree *tree) const;
+
   explicit NE();
   virtual ~NE();
 
  private:
-  crfpp_model_t *model_;
+  // A label string interned at open(). |begin| and |inside| are the
+  // labels whose first letter is replaced with 'B' and 'I', and
+  // |type| identifies the part after "B-"/"I-" (-1 if none).
+  struct Label {
+    std::string name;
+    int         begin;
+    int         inside;
+    int         type;
+  };
+
+  int intern(const std::string &name);
+  bool add_labels(const std::vector<std::string> &names);
+
+  scoped_ptr<CRFModel> crf_model_;  // native decoder
+  crfpp_model_t *model_;            // CRF++, used when crf_model_ is 0
+  std::vector<Label> labels_;
+  std::vector<std::string> types_;
+  std::vector<int> y_labels_;       // label id of the model -> labels_
+  int outside_;                     // "O"
+  scoped_ptr<PatternMatcher> matcher_;  // ne-rule, 0 if not given
   std::string ne_composite_ipa_;
   std::string ne_composite_juman_;
   std::string ne_composite_unidic_;
@@ -69,12 +69,22 @@ size_t lookup(const DoubleArray *array,
   return seekto;
 }
 
+// lead_mblen() returns the length of a character from its first
+// byte alone, or 0 when the following bytes have to be examined.
 class utf8_mblen_t {
  public:
   static void mblen(const char *begin,
                     const char *end, size_t *mblen) {
     CaboCha::utf8_to_ucs2(begin, end, mblen);
   }
+  static size_t lead_mblen(unsigned char c) {
+    if ((c & 0xe0) == 0xc0) return 2;
+    if ((c & 0xf0) == 0xe0) return 3;
+    if ((c & 0xf8) == 0xf0) return 4;
+    if ((c & 0xfc) == 0xf8) return 5;
+    if ((c & 0xfe) == 0xfc) return 6;
+    return 1;
+  }
 };
 
 #ifndef CABOCHA_USE_UTF8_ONLY
@@ -84,6 +94,9 @@ class cp932_mblen_t {
                     const char *end, size_t *mblen) {
     CaboCha::cp932_to_ucs2(begin, end, mblen);
   }
+  static size_t lead_mblen(unsigned char c) {
+    return (c & 0x80) ? 2 : 1;
+  }
 };
 class euc_mblen_t {
  public:
@@ -91,33 +104,139 @@ class euc_mblen_t {
                     const char *end, size_t *mblen) {
     CaboCha::euc_to_ucs2(begin, end, mblen);
   }
+  static size_t lead_mblen(unsigned char c) {
+    if (c == 0x8f) return 0;  // JISX 0212 depends on the trail bytes
+    return (c & 0x80) ? 2 : 1;
+  }
+};
+#endif
+
+#ifndef NORMALIZER_RULE_COMPILE
+// skip[c] is the length of a character beginning with byte c
+// when no rule starts with c, and 0 otherwise.
+template <class T>
+void build_skip_table(const DoubleArray *da, size_t size,
+                      unsigned char *skip) {
+  const int b = da[0].base;
+  for (unsigned int c = 0; c < 256; ++c) {
+    const size_t p = b + c + 1;
+    const bool is_start = (p < size &&
+                           static_cast<unsigned int>(b) == da[p].check);
+    skip[c] = is_start ? 0 : static_cast<unsigned char>(T::lead_mblen(c));
+  }
+}
+
+class SkipTable {
+ public:
+  unsigned char utf8[256];
+#ifndef CABOCHA_USE_UTF8_ONLY
+  unsigned char euc_jp[256];
+  unsigned char cp932[256];
+#endif
+  SkipTable() {
+    build_skip_table<utf8_mblen_t>(
+        utf8_da, sizeof(utf8_da) / sizeof(utf8_da[0]), utf8);
+#ifndef CABOCHA_USE_UTF8_ONLY
+    build_skip_table<euc_mblen_t>(
+        euc_jp_win_da, sizeof(euc_jp_win_da) / sizeof(euc_jp_win_da[0]),
+        euc_jp);
+    build_skip_table<cp932_mblen_t>(
+        cp932_da, sizeof(cp932_da) / sizeof(cp932_da[0]), cp932);
+#endif
+  }
 };
+
+const SkipTable skip_table;
 #endif
 
+// Returns the first position in [begin, end) where a rule matches,
+// or |end|. Characters whose first byte starts no rule are skipped
+// with the table alone. On a match, *result and *mblen are set to
+// the output offset and the length of the matched key.
+template<class T>
+static const char *find_rule(const DoubleArray *da,
+                             const unsigned char *skip,
+                             const char *begin, const char *end,
+                             int *result, size_t *mblen) {
+  while (begin < end) {
+    size_t n = skip[static_cast<unsigned char>(*begin)];
+    if (n == 0 || n > static_cast<size_t>(end - begin)) {
+      *mblen = lookup(da, begin, static_cast<int>(end - begin), result);
+      if (*mblen > 0) {
+        return begin;
+      }
+      T::mblen(begin, end, &n);
+    }
+    begin += n;
+  }
+  return end;
+}
+
+// Appends the normalized [begin, end) to |output|. Returns true
+// if some rule has been applied.
+template<class T>
+static bool appendNormalized(const DoubleArray *da,
+                             const char *ctable,
+                             const unsigned char *skip,
+                             const char *begin,
+                             const char *end,
+                             std::string *output) {
+  bool changed = false;
+  while (begin < end) {
+    int result = 0;
+    size_t mblen = 0;
+    const char *rule = find_rule<T>(da, skip, begin, end, &result, &mblen);
+    output->append(begin, rule - begin);
+    if (rule == end) {
+      break;
+    }
+    *output += &ctable[result];
+    begin = rule + mblen;
+    changed = true;
+  }
+  return changed;
+}
+
 template<class T>
 static void normalizeImpl(const DoubleArray *da,
                           const char *ctable,
+                          const unsigned char *skip,
                           const char *str,
                           size_t len,
                           std::string *output) {
   output->clear();
-  const char *begin = str;
-  const char *end = str + len;
+  appendNormalized<T>(da, ctable, skip, str, str + len, output);
+}
 
-  while (begin < end) {
-    int result = 0;
-    size_t mblen = lookup(da, begin,
-                          static_cast<int>(end - begin),
-                          &result);
-    if (mblen > 0) {
-      *output += &ctable[result];
-      begin += mblen;
-    } else {
-      T::mblen(begin, end, &mblen);
-      output->append(begin, mblen);
-      begin += mblen;
-    }
+template<class T>
+static bool normalizeSentenceImpl(const DoubleArray *da,
+                                  const char *ctable,
+                                  const unsigned char *skip,
+                                  const char *str,
+                                  size_t *offset, size_t size,
+                                  std::string *output) {
+  output->clear();
+  bool changed = false;
+  for (size_t i = 0; i < size; ++i) {
+    const char *begin = str + offset[i];
+    const char *end = str + offset[i + 1];
+    offset[i] = output->size();
+    changed |= appendNormalized<T>(da, ctable, skip, begin, end, output);
+    *output += '\0';
   }
+  offset[size] = output->size();
+  return changed;
+}
+
+template<class T>
+static bool isNormalizedImpl(const DoubleArray *da,
+                             const unsigned char *skip,
+                             const char *str,
+                             size_t len) {
+  int result = 0;
+  size_t mblen = 0;
+  return find_rule<T>(da, skip, str, str + len, &result, &mblen) ==
+      str + len;
 }
 }
 
@@ -140,17 +259,20 @@ void Normalizer::normalize(int charset,
     case UTF8:
       normalizeImpl<utf8_mblen_t>(utf8_da,
                                   utf8_table,
+                                  skip_table.utf8,
                                   str, len, output);
       break;
 #ifndef CABOCHA_USE_UTF8_ONLY
     case EUC_JP:
       normalizeImpl<euc_mblen_t>(euc_jp_win_da,
                                  euc_jp_win_table,
+                                 skip_table.euc_jp,
                                  str, len, output);
       break;
     case CP932:
       normalizeImpl<cp932_mblen_t>(cp932_da,
                                    cp932_table,
+                                   skip_table.cp932,
                                    str, len, output);
       break;
 #endif
@@ -161,6 +283,68 @@ void Normalizer::normalize(int charset,
 #endif
 }
 
+bool Normalizer::normalize(int charset, const char *str,
+                           size_t *offset, size_t size,
+                           std::string *output) {
+#ifndef NORMALIZER_RULE_COMPILE
+  switch (charset) {
+    case UTF8:
+      return normalizeSentenceImpl<utf8_mblen_t>(utf8_da,
+                                                 utf8_table,
+                                                 skip_table.utf8,
+                                                 str, offset, size, output);
+#ifndef CABOCHA_USE_UTF8_ONLY
+    case EUC_JP:
+      return normalizeSentenceImpl<euc_mblen_t>(euc_jp_win_da,
+                                                euc_jp_win_table,
+                                                skip_table.euc_jp,
+                                                str, offset, size, output);
+    case CP932:
+      return normalizeSentenceImpl<cp932_mblen_t>(cp932_da,
+                                                  cp932_table,
+                                                  skip_table.cp932,
+                                                  str, offset, size, output);
+#endif
+    default:
+      break;
+  }
+#endif
+  output->clear();
+  for (size_t i = 0; i < size; ++i) {
+    const size_t begin = offset[i];
+    offset[i] = output->size();
+    output->append(str + begin, offset[i + 1] - begin);
+    *output += '\0';
+  }
+  offset[size] = output->size();
+  return false;
+}
+
+bool Normalizer::is_normalized(int charset,
+                               const char *str, size_t len) {
+#ifndef NORMALIZER_RULE_COMPILE
+  switch (charset) {
+    case UTF8:
+      return isNormalizedImpl<utf8_mblen_t>(utf8_da,
+                                            skip_table.utf8,
+                                            str, len);
+#ifndef CABOCHA_USE_UTF8_ONLY
+    case EUC_JP:
+      return isNormalizedImpl<euc_mblen_t>(euc_jp_win_da,
+                                           skip_table.euc_jp,
+                                           str, len);
+    case CP932:
+      return isNormalizedImpl<cp932_mblen_t>(cp932_da,
+                                             skip_table.cp932,
+                                             str, len);
+#endif
+    default:
+      break;
+  }
+#endif
+  return true;
+}
+
 void Normalizer::compile(const char *filename,
                          const char *header_filename) {
   const char* charset[3] = { "utf8", "euc_jp_win", "cp932" };
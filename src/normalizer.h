@@ -19,6 +19,21 @@ class Normalizer {
                         const char *str, size_t len,
                         std::string *output);
 
+  // Normalizes a sentence of |size| tokens in one pass. The i-th
+  // token is [str + offset[i], str + offset[i + 1]), and no rule is
+  // applied across a token boundary. The tokens are written to
+  // |output| each followed by '\0', and offset[i] is replaced with the
+  // position of the i-th token in |output|. Returns false if the
+  // output is the same as the input.
+  static bool normalize(int chartype, const char *str,
+                        size_t *offset, size_t size,
+                        std::string *output);
+
+  // Returns true if normalize() would return |str| as it is, so
+  // that the caller can use |str| itself as the normalized string.
+  static bool is_normalized(int chartype,
+                            const char *str, size_t len);
+
   static void compile(const char *filename,
                       const char *header_filename);
 };
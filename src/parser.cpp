@@ -9,14 +9,17 @@
 #include "cabocha.h"
 #include "chunker.h"
 #include "common.h"
+#include "corpus_reader.h"
 #include "dep.h"
 #include "freelist.h"
+#include "joint_tagger.h"
 #include "morph.h"
 #include "ne.h"
 #include "param.h"
 #include "scoped_ptr.h"
 #include "selector.h"
 #include "stream_wrapper.h"
+#include "tree_allocator.h"
 #include "utils.h"
 
 namespace {
@@ -46,6 +49,8 @@ const CaboCha::Option long_options[] = {
    "0 - without NE(default)\n\t\t\t    "
    "1 - output NE with chunk constraint\n\t\t\t    "
    "2 - output NE without chunk constraint" },
+  {"ne-joint",        'j', 0, 0,
+   "tag NE and chunks over one shared feature extraction pass"},
   {"parser-model",    'm', 0, "FILE", "use FILE as parser model file"},
   {"chunker-model",   'M', 0, "FILE", "use FILE as chunker model file"},
   {"ne-model",        'N', 0, "FILE", "use FILE as NE tagger model file"},
@@ -63,6 +68,13 @@ const CaboCha::Option long_options[] = {
   { "mecab-dicdir",    'd', 0, "DIR",  "use DIR as mecab dictionary directory"},
   { "mecab-userdic",    'u', 0, "FILE", "use FILE as mecab user directory"},
   { "output",          'o', 0, "FILE", "use FILE as output file"},
+  { "flush",           'F', 0, "POLICY",
+    "set output flush policy\n\t\t\t    "
+    "sentence - flush after every sentence\n\t\t\t    "
+    "buffer   - flush only when the buffer is full\n\t\t\t    "
+    "N        - flush after every N sentences\n\t\t\t    "
+    "(default: sentence if stdout is a terminal, otherwise buffer)" },
+  { "profile",         'p', 0, 0, "print profiling counters to stderr"},
   { "version",         'v', 0, 0, "show the version and exit"},
   { "help",            'h', 0, 0, "show this help and exit"},
   {0, 0, 0, 0}
@@ -143,6 +155,7 @@ class ParserImpl: public Parser {
                             char*, size_t);
   const char *what() { return what_.str(); }
   const char *version();
+  void        dump_profile(std::ostream *os) const;
 
   ParserImpl() : tree_(0),
                  output_format_(FORMAT_TREE),
@@ -200,6 +213,15 @@ bool ParserImpl::open(const char *arg) {
     analyzer_.push_back(analyzer);                      \
   } while (0)
 
+#define PUSH_NE_AND_CHUNKER() do {                      \
+    if (ne && ne_joint) {                               \
+      PUSH_ANALYZER(JointTagger);                       \
+    } else {                                            \
+      if (ne) PUSH_ANALYZER(NE);                        \
+      PUSH_ANALYZER(Chunker);                           \
+    }                                                   \
+  } while (0)
+
 bool ParserImpl::open(Param *param) {
   close();
 
@@ -233,6 +255,7 @@ bool ParserImpl::open(Param *param) {
 
   const int action = param->get<int>("action-mode");
   const int ne     = param->get<int>("ne");
+  const bool ne_joint = param->get<bool>("ne-joint");
   if (action == TRAINING_MODE) {
     output_format_ = FORMAT_NONE;
   }
@@ -257,19 +280,16 @@ bool ParserImpl::open(Param *param) {
             break;
           case OUTPUT_CHUNK:
             PUSH_ANALYZER(MorphAnalyzer);
-            if (ne) PUSH_ANALYZER(NE);
-            PUSH_ANALYZER(Chunker);
+            PUSH_NE_AND_CHUNKER();
             break;
           case OUTPUT_SELECTION:
             PUSH_ANALYZER(MorphAnalyzer);
-            if (ne) PUSH_ANALYZER(NE);
-            PUSH_ANALYZER(Chunker);
+            PUSH_NE_AND_CHUNKER();
             PUSH_ANALYZER(Selector);
             break;
           case OUTPUT_DEP:
             PUSH_ANALYZER(MorphAnalyzer);
-            if (ne) PUSH_ANALYZER(NE);
-            PUSH_ANALYZER(Chunker);
+            PUSH_NE_AND_CHUNKER();
             PUSH_ANALYZER(Selector);
             PUSH_ANALYZER(DependencyParser);
             break;
@@ -281,23 +301,24 @@ bool ParserImpl::open(Param *param) {
 
     case INPUT_POS:  // case 2
       {
-        if (ne) PUSH_ANALYZER(NE);
         switch (output_layer_) {
           case OUTPUT_POS:
+            if (ne) PUSH_ANALYZER(NE);
             break;
           case OUTPUT_CHUNK:
-            PUSH_ANALYZER(Chunker);
+            PUSH_NE_AND_CHUNKER();
             break;
           case OUTPUT_SELECTION:
-            PUSH_ANALYZER(Chunker);
+            PUSH_NE_AND_CHUNKER();
             PUSH_ANALYZER(Selector);
             break;
           case OUTPUT_DEP:
-            PUSH_ANALYZER(Chunker);
+            PUSH_NE_AND_CHUNKER();
             PUSH_ANALYZER(Selector);
             PUSH_ANALYZER(DependencyParser);
             break;
           default:
+            if (ne) PUSH_ANALYZER(NE);
             break;
         }
         break;
@@ -379,6 +400,9 @@ const Tree* ParserImpl::parse(const char *str, size_t len) {
   // these parameters.
   if (!tree_.get()) {
     tree_.reset(new Tree);
+    // tree_ is rebuilt by the next parse() and never outlives this
+    // parser, so it can keep the nodes of MeCab without copies.
+    tree_->allocator()->borrow_mecab_node = true;
   }
 
   tree_->set_charset(charset_);
@@ -397,6 +421,20 @@ const Tree* ParserImpl::parse(const char *str, size_t len) {
   return tree_.get();
 }
 
+void ParserImpl::dump_profile(std::ostream *os) const {
+  if (!tree_.get()) {
+    return;
+  }
+  const TreeAllocator *allocator = tree_->allocator();
+  if (!allocator || !allocator->ne_sentence_size) {
+    return;
+  }
+  *os << "ne-skip: " << allocator->ne_skip_size << "/"
+      << allocator->ne_sentence_size << " sentences ("
+      << 100.0 * allocator->ne_skip_size / allocator->ne_sentence_size
+      << "%)" << std::endl;
+}
+
 const Tree* ParserImpl::parse(const char *str) {
   return parse(str, std::strlen(str));
 }
@@ -498,6 +536,25 @@ int cabocha_do(int argc, char **argv) {
     std::exit(EXIT_FAILURE);
   }
 
+  // the number of sentences between flushes. 0 means that the output
+  // is written only when CABOCHA_IO_BUFFER_SIZE bytes are accumulated.
+  size_t flush_interval = 0;
+  const std::string flush = param.get<std::string>("flush");
+  if (flush.empty()) {
+    flush_interval =
+        (ofilename == "-" && CaboCha::is_stdout_terminal()) ? 1 : 0;
+  } else if (flush == "sentence") {
+    flush_interval = 1;
+  } else if (flush == "buffer") {
+    flush_interval = 0;
+  } else {
+    const int n = std::atoi(flush.c_str());
+    if (n <= 0) {
+      WHAT_ERROR("invalid flush policy: " << flush);
+    }
+    flush_interval = static_cast<size_t>(n);
+  }
+
   const std::vector <std::string>& rest_ = param.rest_args();
   std::vector<std::string> rest = rest_;
 
@@ -507,40 +564,73 @@ int cabocha_do(int argc, char **argv) {
 
   int input_layer = param.get<int>("input-layer");
   std::string input;
+  std::string output;
+  output.reserve(CABOCHA_IO_BUFFER_SIZE);
+  size_t pending = 0;
 
   for (size_t i = 0; i < rest.size(); ++i) {
-    CaboCha::istream_wrapper ifs(rest[i].c_str());
-
-    if (!*ifs) {
-      WHAT_ERROR("no such file or directory: " << rest[i]);
-    }
-
-    while (true) {
-      if (!CaboCha::read_sentence(ifs.get(), &input, input_layer)) {
-        std::cerr << "too long line #line must be <= "
-                  << CABOCHA_MAX_LINE_SIZE;
-        return false;
-      }
-
-      if (ifs->eof() && input.empty()) {
-        return false;
+    // regular files are mmap()ed and split into sentences in advance;
+    // stdin and pipes are read through the stream.
+    CaboCha::CorpusReader reader;
+    CaboCha::scoped_ptr<CaboCha::istream_wrapper> ifs;
+    if (rest[i] == "-" || !reader.open(rest[i].c_str(), input_layer)) {
+      ifs.reset(new CaboCha::istream_wrapper(rest[i].c_str(),
+                                             CABOCHA_IO_BUFFER_SIZE));
+      if (!**ifs) {
+        WHAT_ERROR("no such file or directory: " << rest[i]);
       }
+    }
 
-      if (ifs->fail()) {
-        std::cerr << "input-beffer overflow. "
-                  << "The line is splitted. use -b #SIZE option."
-                  << std::endl;
-        ifs->clear();
+    for (size_t j = 0; ; ++j) {
+      const char *sentence = 0;
+      size_t length = 0;
+      if (ifs.get()) {
+        if (!CaboCha::read_sentence(ifs->get(), &input, input_layer)) {
+          std::cerr << "too long line #line must be <= "
+                    << CABOCHA_MAX_LINE_SIZE;
+          ofs->write(output.data(), output.size());
+          return false;
+        }
+        if ((*ifs)->eof() && input.empty()) {
+          break;
+        }
+        sentence = input.c_str();
+        length = input.size();
+      } else {
+        if (j >= reader.size()) {
+          break;
+        }
+        sentence = reader.sentence(j);
+        length = reader.sentence_length(j);
       }
 
-      const char *r = parser.parseToString(input.c_str(), input.size());
+      const char *r = parser.parseToString(sentence, length);
       if (!r) {
+        ofs->write(output.data(), output.size());
         WHAT_ERROR(parser.what());
       }
-      *ofs << r << std::flush;
+
+      output.append(r);
+      ++pending;
+      if ((flush_interval > 0 && pending >= flush_interval) ||
+          output.size() >= CABOCHA_IO_BUFFER_SIZE) {
+        ofs->write(output.data(), output.size());
+        if (flush_interval > 0) {
+          ofs->flush();
+        }
+        output.clear();
+        pending = 0;
+      }
     }
   }
 
+  ofs->write(output.data(), output.size());
+  ofs->flush();
+
+  if (param.get<bool>("profile")) {
+    parser.dump_profile(&std::cerr);
+  }
+
   return EXIT_SUCCESS;
 
 #undef WHAT_ERROR
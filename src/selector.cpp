@@ -3,17 +3,34 @@
 //  $Id: selector.cpp 50 2009-05-03 08:25:36Z taku-ku $;
 //
 //  Copyright(C) 2001-2008 Taku Kudo <taku@chasen.org>
+#include <algorithm>
 #include <cstring>
-#include <strstream>
 #include "cabocha.h"
 #include "common.h"
+#include "param.h"
 #include "scoped_ptr.h"
 #include "selector.h"
 #include "selector_pat.h"
+#include "thread.h"
+#include "token_cache.h"
+#include "tree_allocator.h"
 #include "ucs.h"
 #include "utils.h"
 
 namespace CaboCha {
+namespace {
+// pattern ids of PatternMatcher
+enum {
+  KUTOUTEN, OPEN_BRACKET, CLOSE_BRACKET, DYN_A, CASE,
+  IPA_FUNC, IPA_HEAD, JUMAN_FUNC, JUMAN_HEAD,
+  UNIDIC_FUNC, UNIDIC_HEAD, UNIDIC_FUNC2, UNIDIC_HEAD2, UNIDIC_HEAD_PRE,
+  HEAD_RULE, FUNC_RULE
+};
+
+// the last generation given by PatternMatcher::build()
+volatile int matcher_generation = 0;
+}
+
 inline const char *getToken(const Token *token, size_t id) {
   if (token->feature_list_size <= id) {
     return 0;
@@ -24,14 +41,116 @@ inline const char *getToken(const Token *token, size_t id) {
   return token->feature_list[id];
 }
 
-inline void emitTokenFeatures(const char* header,
-                              const Token *token,
-                              size_t pos_size,
-                              std::ostrstream *ostrs) {
+namespace {
+// Builds the feature list of a chunk in the tree arena. A feature
+// is appended piece by piece between begin() and end(), and is
+// terminated with '\0' so that it can be used as it is. When the
+// current block runs out, the feature being built moves to a new
+// block, so nothing is truncated. Chunk::feature_list_size is an
+// unsigned char, so features after the first kMaxFeatureSize are
+// dropped with a warning.
+class FeatureBuilder {
+ public:
+  static const size_t kBlockSize = 2048;
+  static const size_t kMaxFeatureSize = 255;
+
+  void clear() {
+    features_->clear();
+    dropped_ = 0;
+  }
+
+  void begin() {
+    start_ = ptr_;
+  }
+
+  void append(const char *str, size_t length) {
+    if (ptr_ + length >= end_) {
+      grow(length);
+    }
+    std::memcpy(ptr_, str, length);
+    ptr_ += length;
+  }
+
+  void append(const char *str) {
+    append(str, std::strlen(str));
+  }
+
+  void append(char c) {
+    append(&c, 1);
+  }
+
+  void end() {
+    if (ptr_ >= end_) {
+      grow(0);
+    }
+    *ptr_++ = '\0';
+    if (features_->size() < kMaxFeatureSize) {
+      features_->push_back(start_);
+    } else {
+      ++dropped_;
+    }
+  }
+
+  // "<name>:<value>"
+  void add(const char *name, const char *value) {
+    begin();
+    append(name);
+    append(':');
+    append(value);
+    end();
+  }
+
+  void copy(Tree *tree, Chunk *chunk) const {
+    if (dropped_) {
+      std::cerr << "too many features in a chunk: " << dropped_
+                << " features after the first " << kMaxFeatureSize
+                << " are dropped" << std::endl;
+    }
+    const size_t size = features_->size();
+    const char **feature_list = const_cast<const char **>(
+        tree->alloc_char_array(size));
+    std::copy(features_->begin(), features_->end(), feature_list);
+    chunk->feature_list = feature_list;
+    chunk->feature_list_size = static_cast<unsigned char>(size);
+  }
+
+  FeatureBuilder(Tree *tree, std::vector<const char *> *features)
+      : tree_(tree), features_(features),
+        start_(0), ptr_(0), end_(0), dropped_(0) {}
+
+ private:
+  void grow(size_t length) {
+    const size_t used = static_cast<size_t>(ptr_ - start_);
+    const size_t size = std::max(kBlockSize, 2 * (used + length + 1));
+    char *block = tree_->alloc(size);
+    if (used) {
+      std::memcpy(block, start_, used);
+    }
+    start_ = block;
+    ptr_ = block + used;
+    end_ = block + size;
+  }
+
+  Tree *tree_;
+  std::vector<const char *> *features_;
+  char *start_;  // the feature being built
+  char *ptr_;
+  char *end_;
+  size_t dropped_;  // features over kMaxFeatureSize
+};
+
+void emitTokenFeatures(const char* header,
+                       const Token *token,
+                       size_t pos_size,
+                       FeatureBuilder *builder) {
   const char *surface = token->normalized_surface;
   const char *cform = getToken(token, pos_size + 1);
 
-  *ostrs << ' ' << header << "S:" << surface;
+  builder->begin();
+  builder->append(header);
+  builder->append("S:");
+  builder->append(surface);
+  builder->end();
 
   const size_t size =
       std::min(pos_size,
@@ -40,27 +159,47 @@ inline void emitTokenFeatures(const char* header,
     if (std::strcmp("*", token->feature_list[k]) == 0) {
       break;
     }
-    *ostrs << ' ' << header << 'P' << k << ':' << token->feature_list[k];
+    builder->begin();
+    builder->append(header);
+    builder->append('P');
+    builder->append(static_cast<char>('0' + k));
+    builder->append(':');
+    builder->append(token->feature_list[k]);
+    builder->end();
   }
 
   if (cform) {
-    *ostrs << ' ' << header <<  "F:" << cform;
+    builder->begin();
+    builder->append(header);
+    builder->append("F:");
+    builder->append(cform);
+    builder->end();
   }
 }
+}  // namespace
 
-PatternMatcher::PatternMatcher() : matched_result_(true) {}
+PatternMatcher::PatternMatcher()
+    : negative_(0), generation_(0), token_rule_size_(0) {}
 PatternMatcher::~PatternMatcher() {}
 
 void PatternMatcher::clear() {
-  matched_result_ = true;
-  patterns_.clear();
+  da_.clear();
+  keys_.clear();
+  negative_ = 0;
+  generation_ = 0;
+  token_rule_size_ = 0;
+  field_keys_.clear();
+  field_masks_.clear();
+  field_rules_.clear();
+  rule_patterns_.clear();
 }
 
-bool PatternMatcher::compile(const char *pattern,
-                             Iconv *iconv) {
-  clear();
+bool PatternMatcher::add(const char *pattern, int type, size_t id,
+                         Iconv *iconv) {
+  CHECK_DIE(id < kMaxPatternSize) << "too many patterns";
+  const unsigned int bit = 1U << id;
   if (pattern[0] == '!') {
-    matched_result_ = false;
+    negative_ |= bit;
     ++pattern;
   }
 
@@ -70,6 +209,10 @@ bool PatternMatcher::compile(const char *pattern,
       std::cerr << "cannot convert: " << pattern << std::endl;
     }
   }
+
+  // SURFACE and FEATURE keys share one double-array and are
+  // distinguished by the first byte.
+  const char *prefix = (type == SURFACE) ? "S" : "F";
   const size_t len = converted.size();
   const char *pat = converted.c_str();
   if (len >= 3 && pat[0] == '(' && pat[len-1] == ')') {
@@ -81,105 +224,343 @@ bool PatternMatcher::compile(const char *pattern,
     const size_t n = tokenize(buf.get(), "|", col.get(), col.size());
     CHECK_DIE(n < col.size()) << "too long OR nodes";
     for (size_t i = 0; i < n; ++i) {
-      patterns_.push_back(std::string(col[i]));
+      keys_.push_back(std::make_pair(prefix + std::string(col[i]), bit));
     }
   } else {
-    patterns_.push_back(std::string(pat));
+    keys_.push_back(std::make_pair(prefix + std::string(pat), bit));
   }
 
-  return !patterns_.empty();
+  return true;
 }
 
-bool PatternMatcher::match(const char *str) const {
-  for (size_t i = 0; i < patterns_.size(); ++i) {
-    if (patterns_[i] == str) {
-      return matched_result_;
+bool PatternMatcher::add_rule(const TokenRuleSet &rules, size_t id) {
+  CHECK_FALSE(id < kMaxPatternSize) << "too many patterns";
+  CHECK_FALSE(token_rule_size_ + rules.size() <= kMaxTokenRuleSize)
+      << "too many token rules: at most " << kMaxTokenRuleSize
+      << " rules are allowed";
+  const unsigned int bit = 1U << id;
+  if (rules.negative()) {
+    negative_ |= bit;
+  }
+
+  for (size_t i = 0; i < rules.size(); ++i) {
+    CHECK_FALSE(rules.rule(i).feature_rules.size() < 255)
+        << "too many fields: at most 254 fields are allowed";
+  }
+
+  uint64 mask = 0;
+  for (size_t i = 0; i < rules.size(); ++i) {
+    const uint64 rule_bit = 1ULL << token_rule_size_++;
+    mask |= rule_bit;
+    const TokenRule &rule = rules.rule(i);
+    if (field_rules_.size() < rule.feature_rules.size()) {
+      field_rules_.resize(rule.feature_rules.size(),
+                          std::make_pair(0ULL, 0ULL));
+    }
+    for (size_t j = 0; j < rule.feature_rules.size(); ++j) {
+      const TokenRule::FeatureRule &feature_rule = rule.feature_rules[j];
+      if (feature_rule.values.empty()) {
+        continue;  // "*"
+      }
+      if (feature_rule.not_rule) {
+        field_rules_[j].second |= rule_bit;
+      } else {
+        field_rules_[j].first |= rule_bit;
+      }
+      std::string key = "T";
+      key += static_cast<char>(j + 1);
+      for (size_t k = 0; k < feature_rule.values.size(); ++k) {
+        field_keys_[key + feature_rule.values[k]] |= rule_bit;
+      }
     }
   }
-  return !matched_result_;
+  rule_patterns_.push_back(std::make_pair(bit, mask));
+
+  return true;
 }
 
-bool PatternMatcher::prefix_match(const char *str) const {
-  const size_t len = std::strlen(str);
-  for (size_t i = 0; i < patterns_.size(); ++i) {
-    if (len < patterns_[i].size()) {
+bool PatternMatcher::build() {
+  for (std::map<std::string, uint64>::const_iterator it =
+           field_keys_.begin(); it != field_keys_.end(); ++it) {
+    keys_.push_back(std::make_pair(
+        it->first, static_cast<unsigned int>(field_masks_.size())));
+    field_masks_.push_back(it->second);
+  }
+  field_keys_.clear();
+
+  std::sort(keys_.begin(), keys_.end());
+  std::vector<const char *> key;
+  std::vector<size_t> length;
+  std::vector<Darts::DoubleArray::value_type> value;
+  for (size_t i = 0; i < keys_.size(); ++i) {
+    if (!key.empty() && keys_[i].first == keys_[i - 1].first) {
+      value.back() |= keys_[i].second;  // shared by several patterns
       continue;
     }
-    if (0 == std::memcmp(str, patterns_[i].data(),
-                         patterns_[i].size())) {
-      return matched_result_;
+    key.push_back(keys_[i].first.c_str());
+    length.push_back(keys_[i].first.size());
+    value.push_back(keys_[i].second);
+  }
+  CHECK_FALSE(!key.empty())
+      << "no patterns: every field of the rules is \"*\"";
+  CHECK_FALSE(0 == da_.build(key.size(), &key[0], &length[0], &value[0]))
+      << "cannot build pattern matcher";
+  keys_.clear();
+  generation_ = static_cast<unsigned int>(atomic_add(&matcher_generation, 1));
+  return true;
+}
+
+unsigned int PatternMatcher::classify(const Token &token) const {
+  unsigned int result = 0;
+
+  // every prefix of the feature is tested in one walk.
+  size_t node_pos = 0;
+  size_t key_pos = 0;
+  if (da_.traverse("F", node_pos, key_pos, 1) != -2) {
+    const char *feature = token.feature;
+    for (key_pos = 0; feature[key_pos];) {
+      const int r = da_.traverse(feature, node_pos, key_pos, key_pos + 1);
+      if (r == -2) {
+        break;
+      }
+      if (r >= 0) {
+        result |= static_cast<unsigned int>(r);
+      }
     }
   }
-  return !matched_result_;
+
+  // the surface has to match as a whole.
+  node_pos = 0;
+  key_pos = 0;
+  if (da_.traverse("S", node_pos, key_pos, 1) != -2) {
+    const char *surface = token.normalized_surface;
+    key_pos = 0;
+    const int r = da_.traverse(surface, node_pos, key_pos,
+                               std::strlen(surface));
+    if (r >= 0) {
+      result |= static_cast<unsigned int>(r);
+    }
+  }
+
+  // token rules: a rule fails when one of its fields is not in the
+  // listed values, or is in the values of a negated field.
+  if (!rule_patterns_.empty()) {
+    const size_t size = std::min(field_rules_.size(),
+                                 static_cast<size_t>(
+                                     token.feature_list_size));
+    uint64 failed = 0;
+    node_pos = 0;
+    key_pos = 0;
+    const bool has_key = (da_.traverse("T", node_pos, key_pos, 1) != -2);
+    const size_t root = node_pos;
+    for (size_t i = 0; i < size; ++i) {
+      uint64 listed = 0;
+      const char field = static_cast<char>(i + 1);
+      node_pos = root;
+      key_pos = 0;
+      if (has_key && da_.traverse(&field, node_pos, key_pos, 1) != -2) {
+        const char *value = token.feature_list[i];
+        key_pos = 0;
+        const int r = da_.traverse(value, node_pos, key_pos,
+                                   std::strlen(value));
+        if (r >= 0) {
+          listed = field_masks_[r];
+        }
+      }
+      failed |= (field_rules_[i].first & ~listed) |
+          (field_rules_[i].second & listed);
+    }
+    for (size_t i = 0; i < rule_patterns_.size(); ++i) {
+      if (rule_patterns_[i].second & ~failed) {
+        result |= rule_patterns_[i].first;
+      }
+    }
+  }
+
+  return result ^ negative_;
 }
 
-Selector::Selector() {}
+Selector::Selector(): has_head_rule_(false), has_func_rule_(false) {}
 Selector::~Selector() {}
 
-void Selector::close() {}
+void Selector::close() {
+  matcher_.clear();
+  has_head_rule_ = false;
+  has_func_rule_ = false;
+}
 
 bool Selector::open(const Param &param) {
   Iconv iconv;
   iconv.open(UTF8, charset());
-  CHECK_DIE(pat_ipa_func_.compile(IPA_FUNC_PAT, &iconv));
-  CHECK_DIE(pat_ipa_head_.compile(IPA_HEAD_PAT, &iconv));
-  CHECK_DIE(pat_juman_func_.compile(JUMAN_FUNC_PAT, &iconv));
-  CHECK_DIE(pat_juman_head_.compile(JUMAN_HEAD_PAT, &iconv));
-  CHECK_DIE(pat_unidic_func_.compile(UNIDIC_FUNC_PAT, &iconv));
-  CHECK_DIE(pat_unidic_head_.compile(UNIDIC_HEAD_PAT, &iconv));
-  CHECK_DIE(pat_unidic_func2_.compile(UNIDIC_FUNC_PAT2, &iconv));
-  CHECK_DIE(pat_unidic_head2_.compile(UNIDIC_HEAD_PAT2, &iconv));
-  CHECK_DIE(pat_unidic_head_pre_.compile(UNIDIC_HEAD_PRE_PAT, &iconv));
-  CHECK_DIE(pat_kutouten_.compile(KUTOUTEN_PAT, &iconv));
-  CHECK_DIE(pat_open_bracket_.compile(OPEN_BRACKET_PAT,  &iconv));
-  CHECK_DIE(pat_close_bracket_.compile(CLOSE_BRACKET_PAT, &iconv));
-  CHECK_DIE(pat_dyn_a_.compile(DYN_A_PAT, &iconv));
-  CHECK_DIE(pat_case_.compile(CASE_PAT, &iconv));
+  matcher_.clear();
+  CHECK_DIE(matcher_.add(IPA_FUNC_PAT, PatternMatcher::FEATURE,
+                         IPA_FUNC, &iconv));
+  CHECK_DIE(matcher_.add(IPA_HEAD_PAT, PatternMatcher::FEATURE,
+                         IPA_HEAD, &iconv));
+  CHECK_DIE(matcher_.add(JUMAN_FUNC_PAT, PatternMatcher::FEATURE,
+                         JUMAN_FUNC, &iconv));
+  CHECK_DIE(matcher_.add(JUMAN_HEAD_PAT, PatternMatcher::FEATURE,
+                         JUMAN_HEAD, &iconv));
+  CHECK_DIE(matcher_.add(UNIDIC_FUNC_PAT, PatternMatcher::FEATURE,
+                         UNIDIC_FUNC, &iconv));
+  CHECK_DIE(matcher_.add(UNIDIC_HEAD_PAT, PatternMatcher::FEATURE,
+                         UNIDIC_HEAD, &iconv));
+  CHECK_DIE(matcher_.add(UNIDIC_FUNC_PAT2, PatternMatcher::FEATURE,
+                         UNIDIC_FUNC2, &iconv));
+  CHECK_DIE(matcher_.add(UNIDIC_HEAD_PAT2, PatternMatcher::FEATURE,
+                         UNIDIC_HEAD2, &iconv));
+  CHECK_DIE(matcher_.add(UNIDIC_HEAD_PRE_PAT, PatternMatcher::FEATURE,
+                         UNIDIC_HEAD_PRE, &iconv));
+  CHECK_DIE(matcher_.add(KUTOUTEN_PAT, PatternMatcher::SURFACE,
+                         KUTOUTEN, &iconv));
+  CHECK_DIE(matcher_.add(OPEN_BRACKET_PAT, PatternMatcher::SURFACE,
+                         OPEN_BRACKET, &iconv));
+  CHECK_DIE(matcher_.add(CLOSE_BRACKET_PAT, PatternMatcher::SURFACE,
+                         CLOSE_BRACKET, &iconv));
+  CHECK_DIE(matcher_.add(DYN_A_PAT, PatternMatcher::FEATURE,
+                         DYN_A, &iconv));
+  CHECK_DIE(matcher_.add(CASE_PAT, PatternMatcher::FEATURE,
+                         CASE, &iconv));
+
+  // user-defined rules replace the built-in head/func patterns
+  has_head_rule_ = has_func_rule_ = false;
+  const char *kRuleName[] = { "head-rule", "func-rule" };
+  const int kRuleId[] = { HEAD_RULE, FUNC_RULE };
+  for (size_t i = 0; i < 2; ++i) {
+    std::string rule = param.get<std::string>(kRuleName[i]);
+    if (rule.empty()) {
+      continue;
+    }
+    CHECK_FALSE(iconv.convert(&rule))
+        << "cannot convert " << kRuleName[i] << ": " << rule;
+    TokenRuleSet rules;
+    CHECK_FALSE(rules.parse(rule.c_str()))
+        << kRuleName[i] << ": " << rules.what();
+    CHECK_FALSE(matcher_.add_rule(rules, kRuleId[i]))
+        << kRuleName[i] << ": " << matcher_.what();
+    if (kRuleId[i] == HEAD_RULE) {
+      has_head_rule_ = true;
+    } else {
+      has_func_rule_ = true;
+    }
+  }
+  CHECK_FALSE(matcher_.build()) << matcher_.what();
+  return true;
+}
+
+bool load_selector_rules(const char *rcfile, Param *param) {
+  Param rc;
+  if (!rc.load(rcfile)) {
+    return false;
+  }
+  param->set<std::string>("head-rule", rc.get<std::string>("head-rule"));
+  param->set<std::string>("func-rule", rc.get<std::string>("func-rule"));
   return true;
 }
 
 bool Selector::parse(Tree *tree) const {
+  TreeAllocator *allocator = tree->allocator();
+  CHECK_TREE_FALSE(allocator);
+  TokenCache *cache = allocator->mutable_token_cache();
+  FeatureBuilder builder(tree, &allocator->feature);
   const size_t size = tree->chunk_size();
   const size_t pos_size = (tree->posset() == IPA) ? 4 : 2;
 
+  unsigned int head_mask = 0;
+  unsigned int func_mask = 0;
+  switch (tree->posset()) {
+    case UNIDIC:
+      head_mask = 1U << UNIDIC_HEAD2;
+      func_mask = 1U << UNIDIC_FUNC2;
+      break;
+    case IPA:
+      head_mask = 1U << IPA_HEAD;
+      func_mask = 1U << IPA_FUNC;
+      break;
+    case JUMAN:
+      head_mask = 1U << JUMAN_HEAD;
+      func_mask = 1U << JUMAN_FUNC;
+      break;
+    default:
+      break;
+  }
+  if (has_head_rule_) {
+    head_mask = 1U << HEAD_RULE;
+  }
+  if (has_func_rule_) {
+    func_mask = 1U << FUNC_RULE;
+  }
+
   for (size_t i = 0; i < size; ++i) {  // for all chunks
     const Chunk *chunk = tree->chunk(i);
     const size_t token_size = chunk->token_pos + chunk->token_size;
-    const size_t kFeatureBufferSize = 2048;
-    char *buf = tree->alloc(kFeatureBufferSize);
-    std::ostrstream ostrs(buf, kFeatureBufferSize);
+    builder.clear();
 
     // for all tokens
+    size_t head_index = chunk->token_pos;
+    size_t func_index = chunk->token_pos;
+    unsigned int head_class = 0;
+    unsigned int func_class = 0;
+    TokenInfo *head_info = 0;
+    TokenInfo *func_info = 0;
     for (size_t j = chunk->token_pos; j < token_size; ++j) {
       const Token *token = tree->token(j);
-      if (pat_kutouten_.match(token->normalized_surface)) {
-        ostrs << " GPUNC:" << token->normalized_surface;
-        ostrs << " FPUNC:" << token->normalized_surface;
+      TokenInfo *info = cache->find(token, tree->charset(), tree->posset());
+      if (!(info->flags & TokenInfo::PATTERN) ||
+          info->pattern_generation != matcher_.generation()) {
+        info->pattern = matcher_.classify(*token);
+        info->pattern_generation = matcher_.generation();
+        info->flags |= TokenInfo::PATTERN;
+      }
+      const unsigned int c = info->pattern;
+      if (j == chunk->token_pos) {
+        head_class = func_class = c;
+        head_info = func_info = info;
       }
 
-      if (pat_open_bracket_.match(token->normalized_surface)) {
-        ostrs << " GOB:" << token->normalized_surface;
-        ostrs << " FOB:" << token->normalized_surface;
-        ostrs << " GOB:1";
-        ostrs << " FOB:1";
+      if (c & (1U << KUTOUTEN)) {
+        builder.add("GPUNC", token->normalized_surface);
+        builder.add("FPUNC", token->normalized_surface);
       }
 
-      if (pat_close_bracket_.match(token->normalized_surface)) {
-        ostrs << " GCB:" << token->normalized_surface;
-        ostrs << " FCB:" << token->normalized_surface;
-        ostrs << " GCB:1";
-        ostrs << " FCB:1";
+      if (c & (1U << OPEN_BRACKET)) {
+        builder.add("GOB", token->normalized_surface);
+        builder.add("FOB", token->normalized_surface);
+        builder.add("GOB", "1");
+        builder.add("FOB", "1");
+      }
+
+      if (c & (1U << CLOSE_BRACKET)) {
+        builder.add("GCB", token->normalized_surface);
+        builder.add("FCB", token->normalized_surface);
+        builder.add("GCB", "1");
+        builder.add("FCB", "1");
       }
 
       // all particles in a chunk
-      if (pat_case_.prefix_match(token->feature)) {
-        ostrs << " FCASE:" << token->normalized_surface;
+      if (c & (1U << CASE)) {
+        builder.add("FCASE", token->normalized_surface);
+      }
+
+      // the last function word and the last head word
+      if (c & func_mask) {
+        func_index = j;
+        func_class = c;
+        func_info = info;
+      }
+      if (c & head_mask) {
+        head_index = j;
+        head_class = c;
+        head_info = info;
       }
     }
 
-    size_t head_index = 0;
-    size_t func_index = 0;
-    findHead(*tree, *chunk, &head_index, &func_index);
+    if ((tree->posset() == IPA || tree->posset() == UNIDIC) &&
+        head_index > func_index) {
+      func_index = head_index;
+      func_class = head_class;
+      func_info = head_info;
+    }
 
     const Token *htoken = tree->token(head_index);
     const Token *ftoken = tree->token(func_index);
@@ -188,106 +569,58 @@ bool Selector::parse(Tree *tree) const {
                                       chunk->token_size - 1);
 
     // static features
-    emitTokenFeatures("FH", htoken, pos_size, &ostrs);
-    emitTokenFeatures("FF", ftoken, pos_size, &ostrs);
-    emitTokenFeatures("FL", ltoken, pos_size, &ostrs);
-    emitTokenFeatures("FR", rtoken, pos_size, &ostrs);
+    emitTokenFeatures("FH", htoken, pos_size, &builder);
+    emitTokenFeatures("FF", ftoken, pos_size, &builder);
+    emitTokenFeatures("FL", ltoken, pos_size, &builder);
+    emitTokenFeatures("FR", rtoken, pos_size, &builder);
 
     // context features
-    ostrs << " LF:" << ftoken->normalized_surface;
-    ostrs << " RL:" << ltoken->normalized_surface;
-    ostrs << " RH:" << htoken->normalized_surface;
-    ostrs << " RF:" << ftoken->normalized_surface;
+    builder.add("LF", ftoken->normalized_surface);
+    builder.add("RL", ltoken->normalized_surface);
+    builder.add("RH", htoken->normalized_surface);
+    builder.add("RF", ftoken->normalized_surface);
 
     if (i == 0) {
-      ostrs << " FBOS:1";
+      builder.add("FBOS", "1");
     }
     if (i == size - 1) {
-      ostrs << " FEOS:1";
+      builder.add("FEOS", "1");
     }
 
-    if (pat_case_.prefix_match(ftoken->feature)) {
-      ostrs << " GCASE:" << ftoken->normalized_surface;
+    if (func_class & (1U << CASE)) {
+      builder.add("GCASE", ftoken->normalized_surface);
     }
 
     // dynamic features
     const char *fcform = getToken(ftoken, pos_size + 1);
-    if (pat_dyn_a_.prefix_match(ftoken->feature)) {
-      ostrs << " A:" << ftoken->normalized_surface;
+    if (func_class & (1U << DYN_A)) {
+      builder.add("A", ftoken->normalized_surface);
     } else if (fcform) {
-      ostrs << " A:" << fcform;
+      builder.add("A", fcform);
+    } else if (tree->posset() == IPA || tree->posset() == JUMAN) {
+      // TokenCache::pos() joins the same |pos_size| fields
+      builder.add("A", cache->pos(ftoken, func_info));
     } else {
       std::string output;
       concat_feature(ftoken, pos_size, &output);
-      ostrs << " A:" << output;
+      builder.add("A", output.c_str());
     }
 
     // This feature is not used for linear algorithm.
     //    std::string output;
     //    concat_feature(htoken, pos_size, &output);
-    //    ostrs << " B:" << output;
-
-    ostrs << std::ends;
+    //    builder.add("B", output.c_str());
 
     // write to tree
     Chunk *mutable_chunk = tree->mutable_chunk(i);
     mutable_chunk->head_pos = head_index - chunk->token_pos;
     mutable_chunk->func_pos = func_index - chunk->token_pos;
 
-    const int kFeatureSize = 128;
-    scoped_array<char *> feature(new char *[kFeatureSize]);
-    const size_t s = tokenize(buf + 1, " ", feature.get(), kFeatureSize);
-    mutable_chunk->feature_list_size = static_cast<unsigned char>(s);
-    mutable_chunk->feature_list = const_cast<const char **>
-        (tree->alloc_char_array(s));
-    std::copy(feature.get(), feature.get() + s,
-              mutable_chunk->feature_list);
+    builder.copy(tree, mutable_chunk);
   }
 
   tree->set_output_layer(OUTPUT_SELECTION);
 
   return true;
 }
-
-void Selector::findHead(const Tree &tree, const Chunk &chunk,
-                        size_t *head_index, size_t *func_index) const {
-  *head_index = chunk.token_pos;
-  *func_index = chunk.token_pos;
-  const size_t token_size = chunk.token_pos + chunk.token_size;
-
-  const PatternMatcher *func_matcher = NULL;
-  const PatternMatcher *head_matcher = NULL;
-
-  switch (tree.posset()) {
-    case UNIDIC:
-      head_matcher = &pat_unidic_head2_;
-      func_matcher = &pat_unidic_func2_;
-      break;
-    case IPA:
-      head_matcher = &pat_ipa_head_;
-      func_matcher = &pat_ipa_func_;
-      break;
-    case JUMAN:
-      head_matcher = &pat_juman_head_;
-      func_matcher = &pat_juman_func_;
-      break;
-    default:
-      return;
-  }
-
-  for (size_t i = chunk.token_pos; i < token_size; ++i) {
-    const Token *token = tree.token(i);
-    if (func_matcher->prefix_match(token->feature)) {
-      *func_index = i;
-    }
-    if (head_matcher->prefix_match(token->feature)) {
-      *head_index = i;
-    }
-  }
-
-  if ((tree.posset() == IPA || tree.posset() == UNIDIC) &&
-      *head_index > *func_index) {
-    *func_index = *head_index;
-  }
-}
 }
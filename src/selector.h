@@ -7,29 +7,68 @@
 #define CABOCHA_SELECTOR_H_
 
 #include <cstring>
+#include <map>
 #include <string>
 #include <vector>
 #include "analyzer.h"
 #include "cabocha.h"
 #include "common.h"
+#include "darts.h"
+#include "token_rule.h"
 
 namespace CaboCha {
 
 class Iconv;
 
+// Compiles a set of patterns into one double-array, so that a token
+// is tested against all of them in a single walk. A pattern is
+// "STR" or "(STR1|STR2|...)", negated with a leading '!'. SURFACE
+// patterns match the whole normalized surface and FEATURE patterns
+// match a prefix of the feature. classify() returns the bitmask of
+// the patterns matching the token, bit |id| for the pattern |id|.
+// TokenRuleSets added with add_rule() are compiled into the same
+// double-array: every field value a rule lists becomes one key, so
+// a token costs one lookup per field however many rules there are.
 class PatternMatcher {
  public:
+  enum { SURFACE, FEATURE };
+  static const size_t kMaxPatternSize = 31;
+
   PatternMatcher();
   virtual ~PatternMatcher();
 
-  bool compile(const char *pat, Iconv *iconv);
+  bool add(const char *pattern, int type, size_t id, Iconv *iconv);
+  bool add_rule(const TokenRuleSet &rules, size_t id);
+  bool build();
   void clear();
-  bool match(const char *str) const;
-  bool prefix_match(const char *str) const;
+  unsigned int classify(const Token &token) const;
+
+  // A number given by build(), unique to the rules of this matcher
+  // in the process. The results of classify() cached per token are
+  // only valid for the same generation.
+  unsigned int generation() const { return generation_; }
+
+  const char *what() { return what_.str(); }
 
  private:
-  bool matched_result_;
-  std::vector<std::string> patterns_;
+  Darts::DoubleArray da_;
+  std::vector<std::pair<std::string, unsigned int> > keys_;
+  unsigned int negative_;
+  unsigned int generation_;
+
+  // token rules, one bit each
+  static const size_t kMaxTokenRuleSize = 64;
+  size_t token_rule_size_;
+  // "T" + field + value -> token rules listing the value
+  std::map<std::string, uint64> field_keys_;
+  // value of a "T" key in the double-array -> token rules
+  std::vector<uint64> field_masks_;
+  // for each field, token rules requiring a listed value and token
+  // rules requiring an unlisted one
+  std::vector<std::pair<uint64, uint64> > field_rules_;
+  // pattern bit -> its token rules
+  std::vector<std::pair<unsigned int, uint64> > rule_patterns_;
+  whatlog what_;
 };
 
 class Selector: public Analyzer {
@@ -41,13 +80,14 @@ class Selector: public Analyzer {
   virtual ~Selector();
 
  private:
-  void findHead(const Tree &tree, const Chunk &chunk, size_t *hid, size_t *fid) const;
-
-  PatternMatcher pat_kutouten_, pat_open_bracket_, pat_close_bracket_;
-  PatternMatcher pat_dyn_a_, pat_case_;
-  PatternMatcher pat_ipa_func_, pat_ipa_head_;
-  PatternMatcher pat_juman_func_, pat_juman_head_;
-  PatternMatcher pat_unidic_func_, pat_unidic_head_, pat_unidic_func2_, pat_unidic_head2_, pat_unidic_head_pre_;
+  PatternMatcher matcher_;
+  bool has_head_rule_;
+  bool has_func_rule_;
 };
+
+// Copies the head-rule and func-rule of the resource file |rcfile| to
+// |param|, so that a model can be trained with the rules it is used
+// with.
+bool load_selector_rules(const char *rcfile, Param *param);
 }
 #endif
@@ -0,0 +1,120 @@
+// CaboCha -- Yet Another Japanese Dependency Parser
+#include <cctype>
+#include <iostream>
+#include <string>
+#include "common.h"
+#include "sexp.h"
+
+namespace CaboCha {
+namespace {
+void dump_cdr_internal(const Sexp::Cell *cell, std::ostream *os);
+
+void dump_internal(const Sexp::Cell *cell, std::ostream *os) {
+  if (!cell) {
+    *os << "NIL";
+  } else if (cell->is_cons()) {
+    *os << '(';
+    dump_internal(cell->car(), os);
+    dump_cdr_internal(cell->cdr(), os);
+    *os << ')';
+  } else if (cell->is_atom()) {
+    *os << cell->atom();
+  }
+}
+
+void dump_cdr_internal(const Sexp::Cell *cell, std::ostream *os) {
+  if (!cell) return;
+  *os << ' ';
+  if (cell->is_cons()) {
+    dump_internal(cell->car(), os);
+    dump_cdr_internal(cell->cdr(), os);
+  } else {
+    dump_internal(cell, os);
+  }
+}
+
+inline bool is_delimiter(char c) {
+  return (std::isspace(static_cast<unsigned char>(c)) ||
+          c == '(' || c == ')' || c == ';');
+}
+}  // namespace
+
+void Sexp::dump(const Sexp::Cell *cell, std::ostream *os) {
+  dump_internal(cell, os);
+  *os << std::endl;
+}
+
+void Sexp::free() {
+  cell_freelist_.free();
+  char_freelist_.free();
+}
+
+void Sexp::skip(const char **begin, const char *end) {
+  while (*begin < end) {
+    const char c = **begin;
+    if (c == ';') {
+      while (*begin < end && **begin != '\n' && **begin != '\r') {
+        ++(*begin);
+      }
+    } else if (std::isspace(static_cast<unsigned char>(c))) {
+      ++(*begin);
+    } else {
+      break;
+    }
+  }
+}
+
+bool Sexp::read(const char **begin, const char *end, const Cell **cell) {
+  *cell = 0;
+  skip(begin, end);
+  CHECK_FALSE(*begin < end) << "unexpected end of expression";
+  if (**begin == '(') {
+    ++(*begin);
+    return read_list(begin, end, cell);
+  }
+  CHECK_FALSE(**begin != ')') << "unexpected ')'";
+  *cell = read_atom(begin, end);
+  return true;
+}
+
+bool Sexp::read_list(const char **begin, const char *end,
+                     const Cell **cell) {
+  Cell *last = 0;
+  while (true) {
+    skip(begin, end);
+    CHECK_FALSE(*begin < end) << "missing ')'";
+    if (**begin == ')') {
+      ++(*begin);
+      return true;
+    }
+    const Cell *car = 0;
+    if (!read(begin, end, &car)) {
+      return false;
+    }
+    Cell *cons = cell_freelist_.alloc();
+    cons->set_car(car);
+    cons->set_cdr(0);
+    if (last) {
+      last->set_cdr(cons);
+    } else {
+      *cell = cons;
+    }
+    last = cons;
+  }
+  return true;
+}
+
+const Sexp::Cell *Sexp::read_atom(const char **begin, const char *end) {
+  const char *p = *begin;
+  while (*begin < end && !is_delimiter(**begin)) {
+    ++(*begin);
+  }
+  const size_t length = static_cast<size_t>(*begin - p);
+  char *tmp = char_freelist_.alloc(length + 1);
+  std::copy(p, p + length, tmp);
+  tmp[length] = '\0';
+  Cell *cell = cell_freelist_.alloc();
+  cell->set_atom(tmp);
+  return cell;
+}
+}
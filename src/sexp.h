@@ -0,0 +1,75 @@
+// CaboCha -- Yet Another Japanese Dependency Parser
+#ifndef CABOCHA_SEXP_H_
+#define CABOCHA_SEXP_H_
+
+#include <iostream>
+#include "common.h"
+#include "freelist.h"
+
+namespace CaboCha {
+
+// A minimal S-expression reader. Atoms are runs of non-space
+// characters other than '(' and ')', and ';' starts a comment
+// running to the end of the line. The cells are owned by the reader
+// and released by free().
+class Sexp {
+ public:
+  class Cell {
+   public:
+    bool is_cons() const { return (stat_ == CONS); }
+    bool is_atom() const { return (stat_ == ATOM); }
+    void set_car(const Cell *cell) {
+      stat_ = CONS;
+      value_.cons_.car_ = cell;
+    }
+    void set_cdr(const Cell *cell) {
+      stat_ = CONS;
+      value_.cons_.cdr_ = cell;
+    }
+    void set_atom(const char *str) {
+      stat_ = ATOM;
+      value_.atom_ = str;
+    }
+    const Cell *car() const { return value_.cons_.car_; }
+    const Cell *cdr() const { return value_.cons_.cdr_; }
+    const char *atom() const { return value_.atom_; }
+
+   private:
+    enum { CONS, ATOM };
+    struct cons_t {
+      const Cell *car_;
+      const Cell *cdr_;
+    };
+    unsigned char stat_;  // CONS/ATOM
+    union {
+      const char *atom_;
+      cons_t cons_;
+    } value_;
+  };
+
+  // Reads one expression from [*begin, end) and advances |*begin|
+  // past it. Returns false on a syntax error or when no expression
+  // is left. An empty list "()" is read as NIL (0).
+  bool read(const char **begin, const char *end, const Cell **cell);
+
+  // Skips white spaces and comments.
+  static void skip(const char **begin, const char *end);
+
+  static void dump(const Cell *cell, std::ostream *os);
+
+  void free();
+  const char *what() { return what_.str(); }
+
+  explicit Sexp(): cell_freelist_(512), char_freelist_(8192) {}
+  virtual ~Sexp() {}
+
+ private:
+  FreeList<Cell> cell_freelist_;
+  FreeList<char> char_freelist_;
+  whatlog        what_;
+
+  bool read_list(const char **begin, const char *end, const Cell **cell);
+  const Cell *read_atom(const char **begin, const char *end);
+};
+}
+#endif
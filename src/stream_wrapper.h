@@ -17,19 +17,30 @@ namespace CaboCha {
 class istream_wrapper {
  private:
   std::istream* is;
+  char *buf;
  public:
   std::istream &operator*() const  { return *is; }
   std::istream *operator->() const { return is;  }
   std::istream *get() { return is; }
-  explicit istream_wrapper(const char* filename): is(0) {
-    if (std::strcmp(filename, "-") == 0)
+  // |buffer_size| > 0 replaces the default (BUFSIZ) file buffer.
+  explicit istream_wrapper(const char* filename,
+                           size_t buffer_size = 0): is(0), buf(0) {
+    if (std::strcmp(filename, "-") == 0) {
       is = &std::cin;
-    else
-      is = new std::ifstream(WPATH(filename));
+    } else {
+      std::ifstream *ifs = new std::ifstream;
+      if (buffer_size > 0) {
+        buf = new char[buffer_size];
+        ifs->rdbuf()->pubsetbuf(buf, buffer_size);
+      }
+      ifs->open(WPATH(filename));
+      is = ifs;
+    }
   }
 
   ~istream_wrapper() {
     if (is != &std::cin) delete is;
+    delete [] buf;
   }
 };
 
@@ -55,6 +55,14 @@ StringBuffer& StringBuffer::write(const char* str) {
   return this->write(str, std::strlen(str));
 }
 
+StringBuffer& StringBuffer::fill(char c, size_t length) {
+  if (reserve(length)) {
+    std::memset(ptr_ + size_, c, length);
+    size_ += length;
+  }
+  return *this;
+}
+
 StringBuffer& StringBuffer::write(const char* str, size_t length) {
   if (reserve(length)) {
     std::memcpy(ptr_ + size_ , str, length);
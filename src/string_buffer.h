@@ -36,6 +36,7 @@ class StringBuffer {
   StringBuffer& write(char);
   StringBuffer& write(const char*, size_t);
   StringBuffer& write(const char* );
+  StringBuffer& fill(char, size_t);
   StringBuffer& operator<< (double n)             { _DTOA(n); }
   StringBuffer& operator<< (short int n)          { _ITOA(n); }
   StringBuffer& operator<< (int n)                { _ITOA(n); }
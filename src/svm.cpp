@@ -18,6 +18,7 @@
 #include "mmap.h"
 #include "scoped_ptr.h"
 #include "svm.h"
+#include "thread.h"
 #include "timer.h"
 #include "ucs.h"
 #include "utils.h"
@@ -77,19 +78,84 @@ std::string encodeBER(unsigned int value) {
   return std::string(reinterpret_cast<const char *>(buf), len);
 }
 
-uint64 encodeToUint64(int i1, int i2) {
-  return (static_cast<uint64>(i1) << 32 |
-          static_cast<uint64>(i2));
-}
-
-void decodeFromUint64(uint64 n, unsigned int *i1, unsigned int *i2) {
-  *i1 = static_cast<int>(0xFFFFFFFF & n >> 32);
-  *i2 = static_cast<int>(0xFFFFFFFF & n);
-}
-
 std::string encodeFeatureID(int i1, int i2) {
   return encodeBER(i1) + encodeBER(i2);
 }
+
+// Expands the 2nd-degree features (i1, i2) of the support vectors.
+// The first ids i1 are claimed one by one from |next_id|, and the
+// instances having i1 are visited in order, so that the weight of a
+// pair does not depend on the number of threads. The weights of the
+// pairs of one i1 are accumulated in arrays indexed by i2, so the
+// working memory is bounded by the number of features. The surviving
+// pairs are kept in |feature_trie_output|, which grows with the
+// number of pairs.
+class PairExpander : public thread {
+ public:
+  const SVMModel                          *model;
+  const std::vector<size_t>               *posting_offset;
+  const std::vector<std::pair<int, int> > *posting;  // (instance, position)
+  size_t                                   feature_size;
+  size_t                                   freq_feature_size;
+  size_t                                   minsup;
+  float                                    sigma_pos;
+  float                                    sigma_neg;
+  volatile int                            *next_id;
+  std::vector<float>                      *fweight2;  // rows of own i1 only
+  std::vector<std::pair<std::string, float> > feature_trie_output;
+
+  void run() {
+    std::vector<unsigned char> freq(feature_size, 0);
+    std::vector<float> weight(feature_size, 0.0);
+    std::vector<int> last_i1(feature_size, -1);
+    std::vector<size_t> i2_list;
+    for (;;) {
+      const size_t i1 = atomic_add(next_id, 1) - 1;
+      if (i1 >= feature_size) {
+        break;
+      }
+      i2_list.clear();
+      for (size_t p = (*posting_offset)[i1];
+           p < (*posting_offset)[i1 + 1]; ++p) {
+        const std::vector<int> &x = model->x((*posting)[p].first);
+        const float alpha = model->alpha((*posting)[p].first);
+        for (size_t j = (*posting)[p].second + 1; j < x.size(); ++j) {
+          const size_t i2 = x[j];
+          if (i2 < freq_feature_size) {
+            const size_t index =
+                i1 * (2 * freq_feature_size - 3 - i1) / 2 - 1 + i2;
+            (*fweight2)[index] += 2 * alpha;
+            continue;
+          }
+          if (last_i1[i2] != static_cast<int>(i1)) {
+            last_i1[i2] = i1;
+            i2_list.push_back(i2);
+          }
+          freq[i2]++;
+          weight[i2] += 2 * alpha;
+        }
+      }
+
+      // extract valid patterns only.
+      for (size_t j = 0; j < i2_list.size(); ++j) {
+        const size_t i2 = i2_list[j];
+        const float w = weight[i2];
+        if (static_cast<size_t>(freq[i2]) >= minsup &&
+            (w <= sigma_neg || w >= sigma_pos)) {
+          const std::string key = encodeFeatureID(i1, i2);
+          feature_trie_output.push_back(std::make_pair(key, w));
+        }
+        freq[i2] = 0;
+        weight[i2] = 0.0;
+      }
+    }
+  }
+
+  PairExpander()
+      : model(0), posting_offset(0), posting(0), feature_size(0),
+        freq_feature_size(0), minsup(0), sigma_pos(0.0), sigma_neg(0.0),
+        next_id(0), fweight2(0) {}
+};
 }  // namespace
 
 FastSVMModel::FastSVMModel()
@@ -271,15 +337,30 @@ double FastSVMModel::classify(const std::vector<int> &x) const {
 bool FastSVMModel::compile(const char *filename, const char *output,
                            double sigma, size_t minsup,
                            size_t freq_feature_size,
-                           Iconv *iconv) {
-  progress_timer timer;
-
+                           size_t thread_size,
+                           Iconv *iconv,
+                           std::ostream *os) {
   SVMModel model;
   CHECK_DIE(model.open(filename)) << "no such file or directory: " << filename;
+  return compile(&model, output, sigma, minsup, freq_feature_size,
+                 thread_size, iconv, os);
+}
+
+bool FastSVMModel::compile(SVMModel *model, const char *output,
+                           double sigma, size_t minsup,
+                           size_t freq_feature_size,
+                           size_t thread_size,
+                           Iconv *iconv,
+                           std::ostream *os) {
+  progress_timer timer(*os);
+  // progress_bar() writes to std::cout.
+  const bool progress = (os == &std::cout);
 
-  model.set_param("sigma",  sigma);
-  model.set_param("minsup", static_cast<int>(minsup));
-  model.set_param("charset", encode_charset(iconv->to()));
+  CHECK_DIE(thread_size > 0) << "thread size must be positive value";
+
+  model->set_param("sigma",  sigma);
+  model->set_param("minsup", static_cast<int>(minsup));
+  model->set_param("charset", encode_charset(iconv->to()));
 
   std::string param_str;
   Darts::DoubleArray dic_da;
@@ -292,8 +373,8 @@ bool FastSVMModel::compile(const char *filename, const char *output,
   int bias = 0;
 
   {
-    const std::map<std::string, int> &dic = model.dic();
-    const std::map<std::string, std::string> &param = model.param();
+    const std::map<std::string, int> &dic = model->dic();
+    const std::map<std::string, std::string> &param = model->param();
     for (std::map<std::string, std::string>::const_iterator it = param.begin();
          it != param.end(); ++it) {
       if (!param_str.empty()) {
@@ -329,13 +410,13 @@ bool FastSVMModel::compile(const char *filename, const char *output,
     }
     CHECK_DIE(0 ==
               dic_da.build(str.size(), &str[0], 0, &val[0],
-                           &progress_bar_dic))
+                           progress ? &progress_bar_dic : 0))
         << "unkown error in building double-array";
   }
 
   {
-    const char *sdegree = model.get_param("degree");
-    const char *sbias = model.get_param("bias");
+    const char *sdegree = model->get_param("degree");
+    const char *sbias = model->get_param("bias");
     CHECK_DIE(sdegree) << "degree is not defined";
     CHECK_DIE(sbias) << "bias is not defined";
     const int degree = std::atoi(sdegree);
@@ -344,8 +425,8 @@ bool FastSVMModel::compile(const char *filename, const char *output,
     CHECK_DIE(2 == degree) << "degree must be 2";
     CHECK_DIE(0.0 == fbias) << "bias must be 0.0";
 
-    for (size_t i = 0; i < model.size(); ++i) {
-      const std::vector<int> &x = model.x(i);
+    for (size_t i = 0; i < model->size(); ++i) {
+      const std::vector<int> &x = model->x(i);
       for (size_t i1 = 0; i1 < x.size(); ++i1) {
         feature_size = std::max(feature_size, static_cast<size_t>(x[i1]));
       }
@@ -361,15 +442,15 @@ bool FastSVMModel::compile(const char *filename, const char *output,
     std::vector<std::pair<std::string, float> > feature_trie_output;
 
     // 0th-degree feature (bias)
-    for (size_t i = 0; i < model.size(); ++i) {
-      const float alpha = model.alpha(i);
+    for (size_t i = 0; i < model->size(); ++i) {
+      const float alpha = model->alpha(i);
       fbias -= alpha;
     }
 
     // 1st-degree feature
-    for (size_t i = 0; i < model.size(); ++i) {
-      const std::vector<int> &x = model.x(i);
-      const float alpha = model.alpha(i);
+    for (size_t i = 0; i < model->size(); ++i) {
+      const std::vector<int> &x = model->x(i);
+      const float alpha = model->alpha(i);
       for (size_t i1 = 0; i1 < x.size(); ++i1) {
         fweight1[x[i1]] += 3 * alpha;
       }
@@ -377,26 +458,10 @@ bool FastSVMModel::compile(const char *filename, const char *output,
 
     // 2nd-degree feature
     {
-      // This part can be replaced with buscket mining (prefixspan) algorithm.
-      hash_map<uint64, std::pair<unsigned char, float> > pair_weight;
-      for (size_t i = 0; i < model.size(); ++i) {
-        const std::vector<int> &x = model.x(i);
-        const float alpha = model.alpha(i);
-        for (size_t i1 = 0; i1 < x.size(); ++i1) {
-          for (size_t i2 = i1 + 1; i2 < x.size(); ++i2) {
-            CHECK_DIE(x[i1] < x[i2]);
-            const uint64 key = encodeToUint64(x[i1], x[i2]);
-            std::pair<unsigned char, float> *elm = &pair_weight[key];
-            elm->first++;
-            elm->second += 2 * alpha;
-          }
-        }
-      }
-
       size_t pos_num = 0;
       size_t neg_num = 0;
-      for (size_t i = 0; i < model.size(); ++i) {
-        if (model.alpha(i) > 0) {
+      for (size_t i = 0; i < model->size(); ++i) {
+        if (model->alpha(i) > 0) {
           ++pos_num;
         } else {
           ++neg_num;
@@ -409,25 +474,73 @@ bool FastSVMModel::compile(const char *filename, const char *output,
       CHECK_DIE(sigma_neg <= 0.0);
       CHECK_DIE(sigma_neg <= sigma_pos);
 
-      // extract valid patterns only.
-      for (hash_map<uint64, std::pair<unsigned char, float> >::const_iterator
-               it = pair_weight.begin(); it != pair_weight.end(); ++it) {
-        const size_t freq = static_cast<size_t>(it->second.first);
-        const float w = it->second.second;
-        unsigned int i1 = 0;
-        unsigned int i2 = 0;
-        decodeFromUint64(it->first, &i1, &i2);
-        CHECK_DIE(i1 < i2) << i1 << " " << i2;
-        CHECK_DIE(i1 < feature_size);
-        CHECK_DIE(i2 < feature_size);
-        if (i1 < freq_feature_size && i2 < freq_feature_size) {
-          const size_t index =
-              i1 * (2 * freq_feature_size - 3 - i1) / 2 - 1 + i2;
-          CHECK_DIE(index >= 0 && index < fweight2.size());
-          fweight2[index] = w;
-        } else if (freq >= minsup && (w <= sigma_neg || w >= sigma_pos)) {
-          const std::string key = encodeFeatureID(i1, i2);
-          feature_trie_output.push_back(std::make_pair(key, w));
+      // inverted index from a feature to the instances having it.
+      std::vector<size_t> posting_offset(feature_size + 1, 0);
+      for (size_t i = 0; i < model->size(); ++i) {
+        const std::vector<int> &x = model->x(i);
+        for (size_t i1 = 0; i1 < x.size(); ++i1) {
+          CHECK_DIE(i1 == 0 || x[i1 - 1] < x[i1]);
+          ++posting_offset[x[i1] + 1];
+        }
+      }
+      for (size_t i = 0; i < feature_size; ++i) {
+        posting_offset[i + 1] += posting_offset[i];
+      }
+      std::vector<std::pair<int, int> > posting(posting_offset.back());
+      {
+        std::vector<size_t> pos(posting_offset.begin(),
+                                posting_offset.end() - 1);
+        for (size_t i = 0; i < model->size(); ++i) {
+          const std::vector<int> &x = model->x(i);
+          for (size_t i1 = 0; i1 < x.size(); ++i1) {
+            posting[pos[x[i1]]++] = std::make_pair(static_cast<int>(i),
+                                                   static_cast<int>(i1));
+          }
+        }
+      }
+
+      volatile int next_id = 0;
+      scoped_array<PairExpander> expander(new PairExpander[thread_size]);
+      for (size_t k = 0; k < thread_size; ++k) {
+        expander[k].model = model;
+        expander[k].posting_offset = &posting_offset;
+        expander[k].posting = &posting;
+        expander[k].feature_size = feature_size;
+        expander[k].freq_feature_size = freq_feature_size;
+        expander[k].minsup = minsup;
+        expander[k].sigma_pos = sigma_pos;
+        expander[k].sigma_neg = sigma_neg;
+        expander[k].next_id = &next_id;
+        expander[k].fweight2 = &fweight2;
+      }
+
+      if (thread_size == 1) {
+        expander[0].run();
+      } else {
+        for (size_t k = 0; k < thread_size; ++k) {
+          expander[k].start();
+        }
+        for (size_t k = 0; k < thread_size; ++k) {
+          expander[k].join();
+        }
+      }
+
+      // merge the pairs of the threads, freeing each thread's copy
+      // as soon as it is merged.
+      if (thread_size == 1) {
+        feature_trie_output.swap(expander[0].feature_trie_output);
+      } else {
+        size_t pair_size = 0;
+        for (size_t k = 0; k < thread_size; ++k) {
+          pair_size += expander[k].feature_trie_output.size();
+        }
+        feature_trie_output.reserve(pair_size);
+        for (size_t k = 0; k < thread_size; ++k) {
+          std::vector<std::pair<std::string, float> > &output =
+              expander[k].feature_trie_output;
+          feature_trie_output.insert(feature_trie_output.end(),
+                                     output.begin(), output.end());
+          std::vector<std::pair<std::string, float> >().swap(output);
         }
       }
     }
@@ -477,7 +590,7 @@ bool FastSVMModel::compile(const char *filename, const char *output,
     CHECK_DIE(0 ==
               feature_da.build(feature_trie_output.size(),
                                &str[0], &len[0], &val[0],
-                               &progress_bar_trie))
+                               progress ? &progress_bar_trie : 0))
         << "unkown error in building double-array";
 
     for (size_t i = 0; i < feature_size; ++i) {
@@ -561,16 +674,16 @@ bool FastSVMModel::compile(const char *filename, const char *output,
 
     CHECK_DIE(file_size  == static_cast<size_t>(bofs.tellp()));
 
-    std::cout << std::endl;
-    std::cout << "double array size : " << dic_da_size << std::endl;
-    std::cout << "trie         size : " << feature_da_size << std::endl;
-    std::cout << "feature size      : " << feature_size << std::endl;
-    std::cout << "freq feature size : " << freq_feature_size << std::endl;
-    std::cout << "minsup            : " << minsup << std::endl;
-    std::cout << "bias              : " << bias << std::endl;
-    std::cout << "sigma             : " << sigma << std::endl;
-    std::cout << "normalize factor  : " << normalize_factor << std::endl;
-    std::cout << "Done!\n";
+    *os << std::endl;
+    *os << "double array size : " << dic_da_size << std::endl;
+    *os << "trie         size : " << feature_da_size << std::endl;
+    *os << "feature size      : " << feature_size << std::endl;
+    *os << "freq feature size : " << freq_feature_size << std::endl;
+    *os << "minsup            : " << minsup << std::endl;
+    *os << "bias              : " << bias << std::endl;
+    *os << "sigma             : " << sigma << std::endl;
+    *os << "normalize factor  : " << normalize_factor << std::endl;
+    *os << "Done!\n";
   }
 
   return true;
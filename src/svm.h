@@ -100,12 +100,29 @@ class FastSVMModel : public SVMModelInterface {
   virtual bool sortFeatures() { return false; }
   virtual bool sortInstances() { return false; }
 
+  // Compiles the text model |filename| into the binary model |output|.
+  // The 2nd-degree features are expanded with |thread_size| threads.
+  // The progress is written to |os|; the progress bars of the
+  // double-arrays are drawn only when |os| is std::cout.
   static bool compile(const char *filename,
                       const char *output,
                       double sigma,
                       size_t minsup,
                       size_t freq_feature_size,
-                      Iconv *iconv);
+                      size_t thread_size,
+                      Iconv *iconv,
+                      std::ostream *os);
+
+  // Same as above, but compiles |model| in memory. The parameters of
+  // the compilation are added to |model|.
+  static bool compile(SVMModel *model,
+                      const char *output,
+                      double sigma,
+                      size_t minsup,
+                      size_t freq_feature_size,
+                      size_t thread_size,
+                      Iconv *iconv,
+                      std::ostream *os);
 
  private:
   Mmap<char> mmap_;
@@ -3,15 +3,20 @@
 //  $Id: svm_learn.cpp 50 2009-05-03 08:25:36Z taku-ku $;
 //
 //  Copyright(C) 2001-2008 Taku Kudo <taku@chasen.org>
+#include <algorithm>
 #include <cmath>
+#include <cstddef>
+#include <cstdlib>
 #include <cstring>
 #include <fstream>
 #include <iostream>
 #include <vector>
 #include "common.h"
+#include "example_set.h"
 #include "scoped_ptr.h"
 #include "svm.h"
 #include "svm_learn.h"
+#include "thread.h"
 #include "timer.h"
 #include "utils.h"
 
@@ -19,91 +24,299 @@ namespace CaboCha {
 namespace {
 const double kEPS = 0.1;
 const double kINF = 1e+37;
+const size_t kChunkSize = 256;   // examples given to a thread at once
+const size_t kRoundSize = 4;
 
 inline uint64 hash(int index) {
   return index + 1;   // index '0' is reserved for bias term.
 }
 
 inline uint64 hash(int index1, int index2) {
+  if (index1 > index2) {
+    std::swap(index1, index2);
+  }
   const uint64 result = index1 + 1;
   return static_cast<uint64>(result << 32 | index2);
 }
 
-double classify(const std::vector<int> &x,
-                const std::vector<float> &w,
-                const hash_map<uint64, int> &dic) {
-  double result = w[0];
+// Primal weights of the 2nd polynomial kernel. A weight has the key
+// 0 (bias), hash(i) or hash(i, j). As FastSVMModel::compile() does,
+// the features less than freq_size, which are the most frequent
+// ones after SVMModel::sortFeatures(), and their pairs are kept in
+// dense arrays. Only the other pairs are looked up in a hash.
+class PrimalWeight {
+ public:
+  PrimalWeight(size_t feature_size, size_t freq_size)
+      : bias_(0.0), weight1_(feature_size, 0.0),
+        freq_size_(std::min(freq_size, feature_size)) {
+    if (freq_size_ > 1) {
+      weight2_.resize(freq_size_ * (freq_size_ - 1) / 2, 0.0);
+    }
+  }
 
-  for (size_t i = 0; i < x.size(); ++i) {
-    const uint64 index = hash(x[i]);
-    const hash_map<uint64, int>::const_iterator
-        it = dic.find(index);
-    if (it != dic.end()) {
-      result += w[it->second];
+  size_t size() const {
+    return 1 + weight1_.size() + weight2_.size() + weight_.size();
+  }
+
+  double classify(const std::vector<int> &x) const {
+    double result = bias_;
+    for (size_t i = 0; i < x.size(); ++i) {
+      result += weight1_[x[i]];
+    }
+    for (size_t i = 0; i < x.size(); ++i) {
+      for (size_t j = i + 1; j < x.size(); ++j) {
+        const float *w = pair(x[i], x[j]);
+        if (w) {
+          result += *w;
+        }
+      }
     }
+    return result;
   }
 
-  for (size_t i = 0; i < x.size(); ++i) {
-    for (size_t j = i + 1; j < x.size(); ++j) {
-      const uint64 index = hash(x[i], x[j]);
-      const hash_map<uint64, int>::const_iterator
-          it = dic.find(index);
-      if (it != dic.end()) {
-        result += w[it->second];
+  void update(const std::vector<int> &x, double d) {
+    bias_ += d;
+    for (size_t i = 0; i < x.size(); ++i) {
+      weight1_[x[i]] += 3 * d;
+    }
+    for (size_t i = 0; i < x.size(); ++i) {
+      for (size_t j = i + 1; j < x.size(); ++j) {
+        *insert(hash(x[i], x[j])) += 2 * d;
       }
     }
   }
 
-  return result;
-}
+  // Returns the weight of |key|, or 0 if it is a new rare pair.
+  float *find(uint64 key) {
+    if (key == 0) {
+      return &bias_;
+    } else if ((key >> 32) == 0) {
+      return &weight1_[key - 1];
+    }
+    return const_cast<float *>(pair(static_cast<int>((key >> 32) - 1),
+                                    static_cast<int>(key & 0xffffffff)));
+  }
 
-void update(const std::vector<int> &x,
-            double d,
-            std::vector<float> *w,
-            hash_map<uint64, int> *dic) {
-  (*w)[0] += d;
+  float *insert(uint64 key) {
+    float *w = find(key);
+    if (w) {
+      return w;
+    }
+    dic_.insert(std::make_pair(key, static_cast<int>(weight_.size())));
+    weight_.push_back(0.0);
+    return &weight_.back();
+  }
 
-  for (size_t i = 0; i < x.size(); ++i) {
-    const uint64 index = hash(x[i]);
-    int n = dic->size();
-    std::pair<hash_map<uint64, int>::iterator, bool>
-        r = dic->insert(std::make_pair(index, n));
-    if (r.second) {  // could insert (new index)
-      w->resize(n + 1);
-      (*w)[n] = 0.0;
-    } else {
-      n = r.first->second;
+ private:
+  const float *pair(int index1, int index2) const {
+    if (index1 > index2) {
+      std::swap(index1, index2);
     }
-    (*w)[n] += 3 * d;
+    if (static_cast<size_t>(index2) < freq_size_) {
+      return &weight2_[index1 * (2 * freq_size_ - 3 - index1) / 2 - 1 +
+                       index2];
+    }
+    const hash_map<uint64, int>::const_iterator
+        it = dic_.find(hash(index1, index2));
+    return it == dic_.end() ? 0 : &weight_[it->second];
+  }
+
+  float                 bias_;
+  std::vector<float>    weight1_;  // [feature]
+  std::vector<float>    weight2_;  // [pair of frequent features]
+  std::vector<float>    weight_;   // [dic_[rare pair]]
+  hash_map<uint64, int> dic_;
+  size_t                freq_size_;
+};
+
+inline double delta_weight(const hash_map<uint64, float> &delta,
+                           uint64 index) {
+  const hash_map<uint64, float>::const_iterator it = delta.find(index);
+  return it == delta.end() ? 0.0 : it->second;
+}
+
+// classify() with the updates of this thread scaled by |sigma|.
+double classify(const std::vector<int> &x,
+                const PrimalWeight &w,
+                const hash_map<uint64, float> &delta,
+                double sigma) {
+  const double result = w.classify(x);
+  if (delta.empty()) {
+    return result;
   }
 
+  double d = delta_weight(delta, 0);
+  for (size_t i = 0; i < x.size(); ++i) {
+    d += delta_weight(delta, hash(x[i]));
+  }
   for (size_t i = 0; i < x.size(); ++i) {
     for (size_t j = i + 1; j < x.size(); ++j) {
-      const uint64 index = hash(x[i], x[j]);
-      int n = dic->size();
-      std::pair<hash_map<uint64, int>::iterator, bool>
-          r = dic->insert(std::make_pair(index, n));
-      if (r.second) {  // could insert (new index)
-        w->resize(n + 1);
-        (*w)[n] = 0.0;
-      } else {
-        n = r.first->second;
-      }
-      (*w)[n] += 2 * d;
+      d += delta_weight(delta, hash(x[i], x[j]));
     }
   }
+
+  return result + sigma * d;
 }
 
-bool solveParameters(const std::vector<double> &y,
-                     const std::vector<std::vector<int> > &x,
+// A random number generator (xorshift) for std::random_shuffle().
+// Unlike std::rand(), it has no global state, so that a model does
+// not depend on the other models trained in the same process.
+class Random {
+ public:
+  explicit Random(unsigned int seed) : x_(seed) {}
+  std::ptrdiff_t operator()(std::ptrdiff_t n) {
+    x_ ^= x_ << 13;
+    x_ ^= x_ >> 17;
+    x_ ^= x_ << 5;
+    return static_cast<std::ptrdiff_t>(x_ % static_cast<unsigned int>(n));
+  }
+
+ private:
+  unsigned int x_;
+};
+
+// Runs the coordinate descent over the active examples
+// index[begin, end), taking kChunkSize examples at once.
+//
+// By default, the threads add their updates to w without locks, as
+// in Hogwild!. As w must not grow while the threads run, an update
+// of a new rare pair is kept in |delta| and added to w after all
+// threads finish.
+//
+// In the deterministic mode, each thread takes fixed chunks of the
+// round and keeps all its updates in |delta|, which are added in the
+// order of the threads after the round. As in CoCoA+, the margin is computed with the own
+// updates scaled by the number of threads, so that the sum of the
+// updates still decreases the dual objective.
+class SolverThread : public thread {
+ public:
+  const ExampleSet                     *example;
+  const std::vector<double>            *QD;
+  const std::vector<size_t>            *index;
+  PrimalWeight                         *w;
+  std::vector<double>                  *alpha;
+  std::vector<double>                  *GA;
+  std::vector<char>                    *shrink;
+  volatile int                         *next_chunk;
+  bool   deterministic;
+  size_t id;
+  size_t thread_size;
+  size_t begin;
+  size_t end;
+  double C;
+  double PGmax_old;
+  double PGmin_old;
+
+  hash_map<uint64, float> delta;
+  double PGmax_new;
+  double PGmin_new;
+  int    error;
+
+  SolverThread()
+      : example(0), QD(0), index(0), w(0), alpha(0), GA(0),
+        shrink(0), next_chunk(0), deterministic(false), id(0),
+        thread_size(1), begin(0), end(0), C(0.0),
+        PGmax_old(kINF), PGmin_old(-kINF),
+        PGmax_new(-kINF), PGmin_new(kINF), error(0) {}
+
+  void run() {
+    delta.clear();
+    PGmax_new = -kINF;
+    PGmin_new = kINF;
+    error = 0;
+    const size_t chunk_size = (end - begin + kChunkSize - 1) / kChunkSize;
+    const double sigma = deterministic ?
+        static_cast<double>(thread_size) : 1.0;
+    std::vector<int> x;
+    for (size_t k = 0; ; ++k) {
+      const size_t chunk = deterministic ?
+          id + k * thread_size :
+          static_cast<size_t>(atomic_add(next_chunk, 1) - 1);
+      if (chunk >= chunk_size) {
+        break;
+      }
+      const size_t last = std::min(end, begin + (chunk + 1) * kChunkSize);
+      for (size_t s = begin + chunk * kChunkSize; s < last; ++s) {
+        const size_t i = (*index)[s];
+        const int y = example->y(i);
+        example->x(i, &x);
+        const double margin = deterministic ?
+            classify(x, *w, delta, sigma) : w->classify(x);
+        if (margin * y < 0) { ++error; }
+        (*GA)[i] = margin * y - 1;
+        const double G = (*GA)[i];
+        double PG = 0.0;
+
+        if ((*alpha)[i] == 0.0) {
+          if (G > PGmax_old) {
+            (*shrink)[i] = 1;
+            continue;
+          } else if (G < 0.0) {
+            PG = G;
+          }
+        } else if ((*alpha)[i] == C) {
+          if (G < PGmin_old) {
+            (*shrink)[i] = 1;
+            continue;
+          } else if (G > 0.0) {
+            PG = G;
+          }
+        } else {
+          PG = G;
+        }
+
+        PGmax_new = std::max(PGmax_new, PG);
+        PGmin_new = std::min(PGmin_new, PG);
+
+        if (std::fabs(PG) > 1.0e-12) {
+          const double alpha_old = (*alpha)[i];
+          (*alpha)[i] = std::min(std::max((*alpha)[i] -
+                                          G / (sigma * (*QD)[i]),
+                                          0.0), C);
+          const double d = ((*alpha)[i] - alpha_old) * y;
+          update(x, d);
+        }
+      }
+    }
+  }
+
+ private:
+  void add(uint64 index, double d) {
+    if (!deterministic) {
+      float *weight = w->find(index);
+      if (weight) {
+        *weight += d;
+        return;
+      }
+    }
+    delta[index] += d;
+  }
+
+  void update(const std::vector<int> &x, double d) {
+    add(0, d);
+    for (size_t i = 0; i < x.size(); ++i) {
+      add(hash(x[i]), 3 * d);
+    }
+    for (size_t i = 0; i < x.size(); ++i) {
+      for (size_t j = i + 1; j < x.size(); ++j) {
+        add(hash(x[i], x[j]), 2 * d);
+      }
+    }
+  }
+};
+
+bool solveParameters(const ExampleSet &example,
                      double C,
-                     std::vector<double> *alpha_) {
+                     size_t freq_feature_size,
+                     size_t thread_size,
+                     bool deterministic,
+                     std::vector<double> *alpha_,
+                     std::ostream *os) {
   std::vector<double> alpha(*alpha_);
 
-  CHECK_DIE(alpha.size() == x.size());
-  CHECK_DIE(y.size() == x.size());
+  CHECK_DIE(alpha.size() == example.size());
 
-  const size_t l = y.size();
+  const size_t l = example.size();
   size_t active_size = l;
   double PGmax_old = kINF;
   double PGmin_old = -kINF;
@@ -111,17 +324,23 @@ bool solveParameters(const std::vector<double> &y,
   std::vector<double> QD(l, 0.0);     // kernel(x_i * x_i)
   std::vector<double> GA(l, 0.0);     // margin + 1
 
-  // primal parameters for binary feature
-  std::vector<float> w(1, 0.0);
-  hash_map<uint64, int> dic;
+  std::vector<int> x;
+  int max_id = -1;
+  for (size_t i = 0; i < l; ++i) {
+    example.x(i, &x);
+    if (!x.empty()) {
+      max_id = std::max(max_id, x.back());
+    }
+  }
 
-  // index for the bias.
-  dic[0] = 0;
+  // primal parameters for binary feature
+  PrimalWeight w(max_id + 1, freq_feature_size);
 
   for (size_t i = 0; i < l; ++i) {
     index[i] = i;
+    example.x(i, &x);
     int binary_s = 0;
-    for (size_t j = 0; j < x[i].size(); ++j) {
+    for (size_t j = 0; j < x.size(); ++j) {
       ++binary_s;  // x[i].value * x[i].value == 1 (always)
     }
     QD[i] = (1 + binary_s) * (1 + binary_s);   // 2nd polynomial kernel
@@ -130,69 +349,137 @@ bool solveParameters(const std::vector<double> &y,
   // initialize primal parameters
   for (size_t i = 0; i < l; ++i) {
     if (alpha[i] > 0) {
-      update(x[i], y[i] * alpha[i], &w, &dic);
+      example.x(i, &x);
+      w.update(x, example.y(i) * alpha[i]);
     }
   }
 
+  // a single thread runs the original loop below.
+  scoped_array<SolverThread> threads(
+      thread_size > 1 ? new SolverThread[thread_size] : 0);
+  std::vector<char> shrink(threads.get() ? l : 0, 0);
+  for (size_t k = 0; threads.get() && k < thread_size; ++k) {
+    threads[k].example = &example;
+    threads[k].QD = &QD;
+    threads[k].index = &index;
+    threads[k].w = &w;
+    threads[k].alpha = &alpha;
+    threads[k].GA = &GA;
+    threads[k].shrink = &shrink;
+    threads[k].deterministic = deterministic;
+    threads[k].id = k;
+    threads[k].thread_size = thread_size;
+    threads[k].C = C;
+  }
+
+  Random random(2463534242U);
   const size_t kMaxIteration = 5000;
   for (size_t iter = 1; iter < kMaxIteration; ++iter) {
+    wall_timer wt;
     double PGmax_new = -kINF;
     double PGmin_new = kINF;
     int error = 0;
-    std::random_shuffle(index.begin(), index.begin() + active_size);
-
-    for (size_t s = 0; s < active_size; ++s) {
-      const size_t i = index[s];
-      const double margin = classify(x[i], w, dic);
-      if (margin * y[i] < 0) { ++error; }
-      GA[i] = margin * y[i] - 1;
-      const double G = GA[i];
-      double PG = 0.0;
-
-      if (alpha[i] == 0.0) {
-        if (G > PGmax_old) {
-          active_size--;
-          std::swap(index[s], index[active_size]);
-          s--;
-          continue;
-        } else if (G < 0.0) {
-          PG = G;
+    std::random_shuffle(index.begin(), index.begin() + active_size,
+                        random);
+
+    if (threads.get()) {
+      // The updates kept in |delta| are added to w after every
+      // kRoundSize chunks per thread, which bounds the size of |delta|
+      // in both modes.
+      const size_t round = thread_size * kChunkSize * kRoundSize;
+      for (size_t begin = 0; begin < active_size; begin += round) {
+        volatile int next_chunk = 0;
+        for (size_t k = 0; k < thread_size; ++k) {
+          threads[k].next_chunk = &next_chunk;
+          threads[k].begin = begin;
+          threads[k].end = std::min(active_size, begin + round);
+          threads[k].PGmax_old = PGmax_old;
+          threads[k].PGmin_old = PGmin_old;
+          threads[k].start();
         }
-      } else if (alpha[i] == C) {
-        if (G < PGmin_old) {
-          active_size--;
-          std::swap(index[s], index[active_size]);
-          s--;
-          continue;
-        } else if (G > 0.0) {
-          PG = G;
+        for (size_t k = 0; k < thread_size; ++k) {
+          threads[k].join();
+        }
+
+        for (size_t k = 0; k < thread_size; ++k) {
+          PGmax_new = std::max(PGmax_new, threads[k].PGmax_new);
+          PGmin_new = std::min(PGmin_new, threads[k].PGmin_new);
+          error += threads[k].error;
+          const hash_map<uint64, float> &delta = threads[k].delta;
+          for (hash_map<uint64, float>::const_iterator it = delta.begin();
+               it != delta.end(); ++it) {
+            *w.insert(it->first) += it->second;
+          }
+        }
+      }
+
+      // move the shrunk examples behind the active ones.
+      size_t size = 0;
+      for (size_t s = 0; s < active_size; ++s) {
+        if (!shrink[index[s]]) {
+          std::swap(index[size++], index[s]);
+        } else {
+          shrink[index[s]] = 0;
         }
-      } else {
-        PG = G;
       }
+      active_size = size;
+    } else {
+      for (size_t s = 0; s < active_size; ++s) {
+        const size_t i = index[s];
+        const int y = example.y(i);
+        example.x(i, &x);
+        const double margin = w.classify(x);
+        if (margin * y < 0) { ++error; }
+        GA[i] = margin * y - 1;
+        const double G = GA[i];
+        double PG = 0.0;
+
+        if (alpha[i] == 0.0) {
+          if (G > PGmax_old) {
+            active_size--;
+            std::swap(index[s], index[active_size]);
+            s--;
+            continue;
+          } else if (G < 0.0) {
+            PG = G;
+          }
+        } else if (alpha[i] == C) {
+          if (G < PGmin_old) {
+            active_size--;
+            std::swap(index[s], index[active_size]);
+            s--;
+            continue;
+          } else if (G > 0.0) {
+            PG = G;
+          }
+        } else {
+          PG = G;
+        }
 
-      PGmax_new = std::max(PGmax_new, PG);
-      PGmin_new = std::min(PGmin_new, PG);
+        PGmax_new = std::max(PGmax_new, PG);
+        PGmin_new = std::min(PGmin_new, PG);
 
-      if (std::fabs(PG) > 1.0e-12) {
-        const double alpha_old = alpha[i];
-        alpha[i] = std::min(std::max(alpha[i] - G / QD[i], 0.0), C);
-        const double d = (alpha[i] - alpha_old) * y[i];
-        update(x[i], d, &w, &dic);
+        if (std::fabs(PG) > 1.0e-12) {
+          const double alpha_old = alpha[i];
+          alpha[i] = std::min(std::max(alpha[i] - G / QD[i], 0.0), C);
+          const double d = (alpha[i] - alpha_old) * y;
+          w.update(x, d);
+        }
       }
     }
 
-    std::cout << "iter=" << iter
-              << " kkt=" << PGmax_new - PGmin_new
-              << " error=" << 1.0 * error / x.size()
-              << " feature_size=" << w.size()
-              << " active_size=" << active_size << std::endl;
+    *os << "iter=" << iter
+        << " kkt=" << PGmax_new - PGmin_new
+        << " error=" << 1.0 * error / l
+        << " feature_size=" << w.size()
+        << " active_size=" << active_size
+        << " time=" << wt.elapsed() << std::endl;
 
     if ((PGmax_new - PGmin_new) <= kEPS) {
       if (active_size == l) {
         break;
       } else {
-        std::cout << "\nChecking all parameters..." << std::endl;
+        *os << "\nChecking all parameters..." << std::endl;
         active_size = l;  // restore again
         PGmax_old = kINF;
         PGmin_old = -kINF;
@@ -216,7 +503,7 @@ bool solveParameters(const std::vector<double> &y,
   double loss = 0.0;
   double obj = 0.0;
 
-  for (size_t i = 0; i < y.size(); ++i) {
+  for (size_t i = 0; i < l; ++i) {
     obj += alpha[i] * (GA[i] - 1);
     const double d = GA[i] + 1.0;
     if (d < 0) {
@@ -234,12 +521,12 @@ bool solveParameters(const std::vector<double> &y,
   }
   obj /= 2.0;
 
-  std::cout << std::endl;
-  std::cout << "Error: " << err << std::endl;
-  std::cout << "L1 Loss: " <<  loss << std::endl;
-  std::cout << "BSV: " << bsv << std::endl;
-  std::cout << "SV: " << sv << std::endl;
-  std::cout << "obj: " << obj << std::endl;
+  *os << std::endl;
+  *os << "Error: " << err << std::endl;
+  *os << "L1 Loss: " <<  loss << std::endl;
+  *os << "BSV: " << bsv << std::endl;
+  *os << "SV: " << sv << std::endl;
+  *os << "obj: " << obj << std::endl;
 
   // copy results.
   *alpha_ = alpha;
@@ -249,34 +536,31 @@ bool solveParameters(const std::vector<double> &y,
 }  // namespace
 
 // static
-SVMModel *SVMSolver::learn(const SVMModel &example,
+SVMModel *SVMSolver::learn(const std::map<std::string, int> &dic,
+                           ExampleSet *example,
                            const SVMModel &prev_model,
-                           double cost) {
-  CHECK_DIE(example.size() > 0) << "example size is 0";
-
-  std::vector<std::vector<int> > x;
-  std::vector<double> y;
-  std::vector<double> alpha;
+                           double cost,
+                           size_t freq_feature_size,
+                           size_t thread_size,
+                           bool deterministic,
+                           std::ostream *os) {
+  CHECK_DIE(example->size() > 0) << "example size is 0";
 
   SVMModel *model = new SVMModel;
   CHECK_DIE(model);
-  *(model->mutable_dic()) = example.dic();
+  *(model->mutable_dic()) = dic;
   model->set_param("C", cost);
   model->set_param("degree", 2);
   model->set_param("bias",   0.0);
 
-  for (size_t i = 0; i < example.size(); ++i) {
-    x.push_back(example.x(i));
-    y.push_back(example.alpha(i) > 0 ? +1 : -1);
-    alpha.push_back(0.0);
-  }
+  std::vector<double> alpha(example->size(), 0.0);
 
   if (prev_model.size() > 0) {
-    const std::map<std::string, int> &dic = prev_model.dic();
-    CHECK_DIE(!dic.empty());
+    const std::map<std::string, int> &prev_dic = prev_model.dic();
+    CHECK_DIE(!prev_dic.empty());
     std::map<int, int> old2new;
-    for (std::map<std::string, int>::const_iterator it = dic.begin();
-         it != dic.end(); ++it) {
+    for (std::map<std::string, int>::const_iterator it = prev_dic.begin();
+         it != prev_dic.end(); ++it) {
       CHECK_DIE(!it->first.empty());
       CHECK_DIE(it->second >= 0);
       const int id = model->id(it->first);
@@ -290,26 +574,100 @@ SVMModel *SVMSolver::learn(const SVMModel &example,
       for (size_t j = 0; j < tmp.size(); ++j) {
         tmp[j] = old2new[tmp[j]];
       }
-      x.push_back(tmp);
-      y.push_back(prev_model.alpha(i) > 0 ? +1 : -1);
+      example->add(prev_model.alpha(i) > 0 ? +1 : -1, tmp);
       alpha.push_back(std::fabs(prev_model.alpha(i)));
     }
   }
 
-  CHECK_DIE(x.size() >= 2) << "training data is too small";
-  CHECK_DIE(x.size() == y.size());
-  CHECK_DIE(alpha.size() == y.size());
-  CHECK_DIE(solveParameters(y, x, cost, &alpha));
+  CHECK_DIE(example->size() >= 2) << "training data is too small";
+  CHECK_DIE(alpha.size() == example->size());
+  CHECK_DIE(example->spill()) << example->what();
+  CHECK_DIE(solveParameters(*example, cost, freq_feature_size,
+                            thread_size, deterministic, &alpha, os));
 
+  std::vector<int> x;
   for (size_t i = 0; i < alpha.size(); ++i) {
     if (alpha[i] > 0.0) {
-      model->add(y[i] * alpha[i], x[i]);
+      example->x(i, &x);
+      model->add(example->y(i) * alpha[i], x);
+    }
+  }
+
+  model->compress();
+
+  *os << "Done!\n\n";
+
+  return model;
+}
+
+SVMModel *SVMSolver::update(const std::map<std::string, int> &dic,
+                            const ExampleSet &example,
+                            const SVMModel &prev_model,
+                            double cost,
+                            size_t freq_feature_size,
+                            std::ostream *os) {
+  CHECK_DIE(prev_model.size() > 0) << "old model is empty";
+  const char *degree = prev_model.get_param("degree");
+  CHECK_DIE(degree && std::atoi(degree) == 2) << "degree must be 2";
+
+  SVMModel *model = new SVMModel;
+  CHECK_DIE(model);
+  *(model->mutable_dic()) = prev_model.dic();
+  model->set_param("C", cost);
+  model->set_param("degree", 2);
+  model->set_param("bias",   0.0);
+
+  // the features new to the old model get the next ids.
+  std::vector<const std::string *> key(dic.size());
+  for (std::map<std::string, int>::const_iterator it = dic.begin();
+       it != dic.end(); ++it) {
+    CHECK_DIE(it->second >= 0 && it->second < static_cast<int>(key.size()));
+    key[it->second] = &it->first;
+  }
+  std::vector<int> old2new(key.size());
+  for (size_t i = 0; i < key.size(); ++i) {
+    old2new[i] = model->id(*key[i]);
+  }
+
+  PrimalWeight w(model->dic().size(), freq_feature_size);
+  for (size_t i = 0; i < prev_model.size(); ++i) {
+    w.update(prev_model.x(i), prev_model.alpha(i));
+    model->add(prev_model.alpha(i), prev_model.x(i));
+  }
+
+  // A PA-I step is a coordinate descent step of the dual from
+  // alpha = 0, so the example is just added as a support vector.
+  std::vector<int> x;
+  size_t err = 0;
+  size_t sv = 0;
+  for (size_t i = 0; i < example.size(); ++i) {
+    example.x(i, &x);
+    for (size_t j = 0; j < x.size(); ++j) {
+      x[j] = old2new[x[j]];
+    }
+    std::sort(x.begin(), x.end());
+    const int y = example.y(i);
+    const double G = w.classify(x) * y - 1;
+    if (G + 1 <= 0) {
+      ++err;
+    }
+    if (G >= 0) {
+      continue;
     }
+    const double QD = (1.0 + x.size()) * (1.0 + x.size());
+    const double alpha = std::min(-G / QD, cost);
+    w.update(x, y * alpha);
+    model->add(y * alpha, x);
+    ++sv;
   }
 
+  *os << "example_size=" << example.size()
+      << " error=" << 1.0 * err / example.size()
+      << " new_sv_size=" << sv << std::endl;
+
   model->compress();
 
-  std::cout << "Done!\n\n";
+  *os << "Done!\n\n";
 
   return model;
 }
@@ -3,16 +3,41 @@
 //  $Id: svm_learn.h 41 2008-01-20 09:31:34Z taku-ku $;
 //
 //  Copyright(C) 2001-2008 Taku Kudo <taku@chasen.org>
+#include <iostream>
+#include <map>
+#include <string>
 #include <vector>
 
 namespace CaboCha {
 
+class ExampleSet;
 class SVMModel;
 
 class SVMSolver {
  public:
-  static SVMModel *learn(const SVMModel &example,
+  // Solves the dual with |thread_size| threads. With more than one
+  // thread, |deterministic| makes the result independent of the
+  // timing of the threads. The weights of the |freq_feature_size|
+  // most frequent features and their pairs are kept in dense arrays.
+  // The support vectors of |prev_model| are appended to |example|.
+  // The progress is written to |os|.
+  static SVMModel *learn(const std::map<std::string, int> &dic,
+                         ExampleSet *example,
                          const SVMModel &prev_model,
-                         double cost);
+                         double cost,
+                         size_t freq_feature_size,
+                         size_t thread_size,
+                         bool deterministic,
+                         std::ostream *os);
+
+  // Updates |prev_model| online: for each of |example| in order, a
+  // passive-aggressive (PA-I) step adds it to the support vectors.
+  // The features are mapped to the ids of |prev_model| through |dic|.
+  static SVMModel *update(const std::map<std::string, int> &dic,
+                          const ExampleSet &example,
+                          const SVMModel &prev_model,
+                          double cost,
+                          size_t freq_feature_size,
+                          std::ostream *os);
 };
 }  // namespace
@@ -0,0 +1,102 @@
+// CaboCha -- Yet Another Japanese Dependency Parser
+#ifndef CABOCHA_THREAD_H_
+#define CABOCHA_THREAD_H_
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#ifdef HAVE_PTHREAD_H
+#include <pthread.h>
+#else
+#ifdef _WIN32
+#include <windows.h>
+#include <process.h>
+#endif
+#endif
+
+#if defined HAVE_PTHREAD_H
+#define CABOCHA_USE_THREAD 1
+#endif
+
+#if (defined(_WIN32) && !defined(__CYGWIN__))
+#define CABOCHA_USE_THREAD 1
+#define BEGINTHREAD(src, stack, func, arg, flag, id)                    \
+  (HANDLE)_beginthreadex((void *)(src), (unsigned)(stack),              \
+                         (unsigned(_stdcall *)(void *))(func),          \
+                         (void *)(arg), (unsigned)(flag),               \
+                         (unsigned *)(id))
+#endif
+
+namespace CaboCha {
+
+// Adds |n| to |*p| and returns the new value.
+inline int atomic_add(volatile int *p, int n) {
+#if (defined(_WIN32) && !defined(__CYGWIN__))
+  return InterlockedExchangeAdd(reinterpret_cast<volatile long *>(p),
+                                static_cast<long>(n)) + n;
+#elif defined(__GNUC__) && defined(CABOCHA_USE_THREAD)
+  return __sync_add_and_fetch(p, n);
+#else
+  return *p += n;
+#endif
+}
+
+// A thread running run(). Without thread support, or when a thread
+// cannot be created, start() runs it in the caller.
+class thread {
+ private:
+#ifdef HAVE_PTHREAD_H
+  pthread_t hnd_;
+#else
+#ifdef _WIN32
+  HANDLE  hnd_;
+#endif
+#endif
+  bool started_;
+
+ public:
+  static void* wrapper(void *ptr) {
+    thread *p = static_cast<thread *>(ptr);
+    p->run();
+    return 0;
+  }
+
+  virtual void run() {}
+
+  void start() {
+#ifdef HAVE_PTHREAD_H
+    started_ = (pthread_create(&hnd_, 0, &thread::wrapper,
+                               static_cast<void *>(this)) == 0);
+#else
+#ifdef _WIN32
+    DWORD id;
+    hnd_ = BEGINTHREAD(0, 0, &thread::wrapper, this, 0, &id);
+    started_ = (hnd_ != 0);
+#endif
+#endif
+    if (!started_) {
+      run();
+    }
+  }
+
+  void join() {
+    if (!started_) {
+      return;
+    }
+#ifdef HAVE_PTHREAD_H
+    pthread_join(hnd_, 0);
+#else
+#ifdef _WIN32
+    WaitForSingleObject(hnd_, INFINITE);
+    CloseHandle(hnd_);
+#endif
+#endif
+    started_ = false;
+  }
+
+  thread() : started_(false) {}
+  virtual ~thread() {}
+};
+}
+#endif
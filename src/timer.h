@@ -11,6 +11,14 @@
 #include <string>
 #include <limits>
 
+#ifdef HAVE_SYS_TIME_H
+#include <sys/time.h>
+#endif
+
+#if defined(_WIN32) && !defined(__CYGWIN__)
+#include <windows.h>
+#endif
+
 #undef max
 #undef min
 
@@ -36,6 +44,30 @@ namespace CaboCha {
     std::clock_t start_time_;
   };
 
+  // timer measures the CPU time, which is summed up over all
+  // threads. wall_timer measures the elapsed real time.
+  class wall_timer {
+  public:
+    explicit wall_timer() { start_time_ = now(); }
+    void   restart() { start_time_ = now(); }
+    double elapsed() const { return now() - start_time_; }
+
+  private:
+    static double now() {
+#if defined(_WIN32) && !defined(__CYGWIN__)
+      return GetTickCount() / 1000.0;
+#elif defined(HAVE_SYS_TIME_H)
+      struct timeval tv;
+      gettimeofday(&tv, 0);
+      return tv.tv_sec + tv.tv_usec / 1000000.0;
+#else
+      return static_cast<double>(std::time(0));
+#endif
+    }
+
+    double start_time_;
+  };
+
   class progress_timer : public timer {
 
   public:
@@ -0,0 +1,122 @@
+// CaboCha -- Yet Another Japanese Dependency Parser
+#include <cstring>
+#include <string>
+#include "cabocha.h"
+#include "common.h"
+#include "token_cache.h"
+#include "utils.h"
+
+namespace CaboCha {
+namespace {
+const size_t kInitialTableSize = 1024;
+
+// FNV-1a over "surface\0feature"
+unsigned int hash_token(const char *surface, const char *feature) {
+  unsigned int h = 2166136261U;
+  for (const char *p = surface; *p; ++p) {
+    h = (h ^ static_cast<unsigned char>(*p)) * 16777619U;
+  }
+  h *= 16777619U;
+  for (const char *p = feature; *p; ++p) {
+    h = (h ^ static_cast<unsigned char>(*p)) * 16777619U;
+  }
+  return h;
+}
+}  // namespace
+
+TokenCache::TokenCache(size_t capacity)
+    : table_(kInitialTableSize, static_cast<TokenInfo *>(0)),
+      info_freelist_(BUF_SIZE),
+      char_freelist_(BUF_SIZE * 16),
+      size_(0), capacity_(capacity),
+      charset_(-1), posset_(-1) {}
+
+void TokenCache::clear() {
+  std::fill(table_.begin(), table_.end(), static_cast<TokenInfo *>(0));
+  info_freelist_.free();
+  char_freelist_.free();
+  size_ = 0;
+}
+
+void TokenCache::rehash(size_t table_size) {
+  std::vector<TokenInfo *> table(table_size, static_cast<TokenInfo *>(0));
+  const size_t mask = table_size - 1;
+  for (size_t i = 0; i < table_.size(); ++i) {
+    if (!table_[i]) {
+      continue;
+    }
+    size_t n = table_[i]->hash & mask;
+    while (table[n]) {
+      n = (n + 1) & mask;
+    }
+    table[n] = table_[i];
+  }
+  table_.swap(table);
+}
+
+const char *TokenCache::strdup(const char *str) {
+  const size_t size = std::strlen(str);
+  char *n = char_freelist_.alloc(size + 1);
+  std::memcpy(n, str, size + 1);
+  return n;
+}
+
+TokenInfo *TokenCache::find(const Token *token, int charset, int posset) {
+  if (charset != charset_ || posset != posset_) {
+    clear();
+    charset_ = charset;
+    posset_ = posset;
+  }
+
+  const char *surface = token->normalized_surface;
+  const char *feature = token->feature;
+  const unsigned int hash = hash_token(surface, feature);
+  const size_t mask = table_.size() - 1;
+  size_t n = hash & mask;
+  for (; table_[n]; n = (n + 1) & mask) {
+    TokenInfo *info = table_[n];
+    if (info->hash == hash &&
+        std::strcmp(info->surface, surface) == 0 &&
+        std::strcmp(info->feature, feature) == 0) {
+      return info;
+    }
+  }
+
+  // entries handed out for the current sentence must stay valid,
+  // so the table only grows here. TreeAllocator::free() drops it
+  // when it is full.
+  TokenInfo *info = info_freelist_.alloc();
+  info->surface = strdup(surface);
+  info->feature = strdup(feature);
+  info->pos = 0;
+  info->char_feature = 0;
+  info->pattern = 0;
+  info->pattern_generation = 0;
+  info->ne_candidate = false;
+  info->ne_generation = 0;
+  info->hash = hash;
+  info->flags = 0;
+  table_[n] = info;
+  ++size_;
+
+  if (size_ * 2 > table_.size()) {
+    rehash(table_.size() * 2);
+  }
+
+  return info;
+}
+
+const char *TokenCache::pos(const Token *token, TokenInfo *info) {
+  if (!(info->flags & TokenInfo::POS)) {
+    std::string tmp;
+    if (posset_ == IPA || posset_ == UNIDIC) {
+      concat_feature(token, 4, &tmp);
+    } else if (posset_ == JUMAN) {
+      concat_feature(token, 2, &tmp);
+    }
+    info->pos = strdup(tmp.c_str());
+    info->flags |= TokenInfo::POS;
+  }
+  return info->pos;
+}
+}
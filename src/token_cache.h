@@ -0,0 +1,66 @@
+// CaboCha -- Yet Another Japanese Dependency Parser
+#ifndef CABOCHA_TOKEN_CACHE_H_
+#define CABOCHA_TOKEN_CACHE_H_
+
+#include <vector>
+#include "cabocha.h"
+#include "freelist.h"
+
+namespace CaboCha {
+
+// Per-token results shared by the chunker, the named entity
+// recognizer and the selector. They only depend on the surface and
+// the feature of a token, so frequent tokens are computed once.
+// |pattern| and |ne_candidate| also depend on the rules of the
+// PatternMatcher, so they keep the generation of the matcher which
+// computed them, and are recomputed for any other matcher.
+struct TokenInfo {
+  enum { POS = 1, CHAR_FEATURE = 2, PATTERN = 4, NE_CANDIDATE = 8 };
+  const char   *surface;
+  const char   *feature;
+  const char   *pos;           // concatenated POS used by chunker/ne
+  const char   *char_feature;  // character class feature used by ne
+  unsigned int  pattern;       // PatternMatcher::classify()
+  unsigned int  pattern_generation;
+  bool          ne_candidate;  // matches ne-rule
+  unsigned int  ne_generation;
+  unsigned int  hash;
+  unsigned int  flags;         // fields already computed
+};
+
+// A bounded hash table of TokenInfo keyed by (surface, feature).
+// The cache lives in TreeAllocator and is never shared between
+// threads. Entries stay valid until the end of the current
+// sentence; the whole table is dropped when it gets full.
+class TokenCache {
+ public:
+  // Returns the entry of |token|, adding an empty one if needed.
+  TokenInfo *find(const Token *token, int charset, int posset);
+
+  // Returns the concatenated POS of |token| used as a chunker and
+  // ne feature.
+  const char *pos(const Token *token, TokenInfo *info);
+
+  // Copies |str| into the cache.
+  const char *strdup(const char *str);
+
+  bool full() const { return size_ >= capacity_; }
+  size_t size() const { return size_; }
+  void clear();
+
+  explicit TokenCache(size_t capacity);
+  virtual ~TokenCache() {}
+
+ private:
+  void rehash(size_t table_size);
+
+  std::vector<TokenInfo *> table_;
+  FreeList<TokenInfo>      info_freelist_;
+  FreeList<char>           char_freelist_;
+  size_t                   size_;
+  size_t                   capacity_;
+  int                      charset_;
+  int                      posset_;
+};
+}
+#endif
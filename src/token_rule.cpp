@@ -0,0 +1,89 @@
+// CaboCha -- Yet Another Japanese Dependency Parser
+#include <cstring>
+#include <string>
+#include "common.h"
+#include "sexp.h"
+#include "token_rule.h"
+
+namespace CaboCha {
+
+void TokenRuleSet::clear() {
+  rules_.clear();
+  negative_ = false;
+}
+
+bool TokenRuleSet::build(const Sexp::Cell *cell, TokenRule *rule) {
+  rule->feature_rules.clear();
+  bool negate_next = false;
+  for (; cell; cell = cell->cdr()) {
+    const Sexp::Cell *car = cell->car();
+    CHECK_FALSE(car) << "empty list in a token rule";
+    TokenRule::FeatureRule feature_rule;
+    feature_rule.not_rule = negate_next;
+    negate_next = false;
+    if (car->is_atom()) {
+      const char *atom = car->atom();
+      if (std::strcmp(atom, "^") == 0) {
+        CHECK_FALSE(!feature_rule.not_rule) << "double negation: ^ ^";
+        negate_next = true;
+        continue;
+      }
+      if (atom[0] == '^') {
+        CHECK_FALSE(!feature_rule.not_rule) << "double negation: " << atom;
+        feature_rule.not_rule = true;
+        ++atom;
+      }
+      if (std::strcmp(atom, "*") == 0) {
+        CHECK_FALSE(!feature_rule.not_rule) << "* cannot be negated";
+      } else {
+        feature_rule.values.push_back(atom);
+      }
+    } else {
+      for (const Sexp::Cell *cell2 = car; cell2; cell2 = cell2->cdr()) {
+        CHECK_FALSE(cell2->car() && cell2->car()->is_atom())
+            << "nested list in a token rule";
+        const char *atom = cell2->car()->atom();
+        CHECK_FALSE(atom[0] != '^' && std::strcmp(atom, "*") != 0)
+            << "^ and * are not allowed in a list: " << atom;
+        feature_rule.values.push_back(atom);
+      }
+    }
+    rule->feature_rules.push_back(feature_rule);
+  }
+  CHECK_FALSE(!negate_next) << "^ at the end of a token rule";
+
+  return true;
+}
+
+bool TokenRuleSet::parse(const char *str) {
+  clear();
+  const char *begin = str;
+  const char *end = str + std::strlen(str);
+  Sexp::skip(&begin, end);
+  if (begin < end && *begin == '!') {
+    negative_ = true;
+    ++begin;
+  }
+
+  Sexp sexp;
+  while (true) {
+    Sexp::skip(&begin, end);
+    if (begin == end) {
+      break;
+    }
+    const Sexp::Cell *cell = 0;
+    CHECK_FALSE(sexp.read(&begin, end, &cell)) << sexp.what();
+    CHECK_FALSE(!cell || cell->is_cons())
+        << "a token rule must be a list: " << cell->atom();
+    TokenRule rule;
+    if (!build(cell, &rule)) {
+      return false;
+    }
+    rules_.push_back(rule);
+  }
+
+  CHECK_FALSE(!rules_.empty()) << "no token rule: " << str;
+
+  return true;
+}
+}
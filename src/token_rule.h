@@ -0,0 +1,53 @@
+// CaboCha -- Yet Another Japanese Dependency Parser
+#ifndef CABOCHA_TOKEN_RULE_H_
+#define CABOCHA_TOKEN_RULE_H_
+
+#include <string>
+#include <vector>
+#include "common.h"
+#include "sexp.h"
+
+namespace CaboCha {
+
+// Rule that matches a single token by the fields of its feature.
+//
+//   (動詞 (非自立 接尾) * ^基本形)
+//
+// The i-th element constrains feature_list[i]: an atom matches the
+// field as it is, a list matches any of its atoms, "*" matches any
+// field, and "^" negates the element that follows it (or the rest of
+// the atom, as in "^基本形"). Fields the token does not have are not
+// tested.
+struct TokenRule {
+  struct FeatureRule {
+    bool not_rule;
+    std::vector<std::string> values;  // empty for "*"
+  };
+  std::vector<FeatureRule> feature_rules;
+};
+
+// A disjunction of TokenRules, written as a sequence of rules. A
+// leading '!' negates the whole set.
+//
+//   !(助詞) (助動詞) (動詞 (非自立 接尾))
+class TokenRuleSet {
+ public:
+  bool parse(const char *str);
+  size_t size() const { return rules_.size(); }
+  const TokenRule &rule(size_t i) const { return rules_[i]; }
+  bool negative() const { return negative_; }
+  void clear();
+  const char *what() { return what_.str(); }
+
+  explicit TokenRuleSet(): negative_(false) {}
+  virtual ~TokenRuleSet() {}
+
+ private:
+  bool build(const Sexp::Cell *cell, TokenRule *rule);
+
+  std::vector<TokenRule> rules_;
+  bool                   negative_;
+  whatlog                what_;
+};
+}
+#endif
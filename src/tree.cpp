@@ -4,6 +4,7 @@
 //
 //  Copyright(C) 2001-2008 Taku Kudo <taku@chasen.org>
 #include <algorithm>
+#include <cstring>
 #include <vector>
 #include <string>
 #include <sstream>
@@ -19,16 +20,21 @@
 namespace CaboCha {
 namespace {
 
-size_t get_string_length(const std::string &str, int charset) {
-  const char *begin = str.c_str();
-  const char *end = str.c_str() + str.size();
+// Display width of |str|: one column for a single byte character,
+// two columns for a multi byte character.
+size_t get_string_length(const char *str, size_t length, int charset) {
+  if (charset == UTF8) {
+    size_t width = 0;
+    utf8_count(str, str + length, &width);
+    return width;
+  }
+
+  const char *begin = str;
+  const char *end = str + length;
   size_t mblen = 0;
   size_t result = 0;
   while (begin < end) {
     switch (charset) {
-      case UTF8:
-        utf8_to_ucs2(begin, end, &mblen);
-        break;
 #ifndef CABOCHA_USE_UTF8_ONLY
       case EUC_JP:
         euc_to_ucs2(begin, end, &mblen);
@@ -50,28 +56,83 @@ size_t get_string_length(const std::string &str, int charset) {
   return result;
 }
 
+
+// Returns the next line of [*begin, *begin + *length), terminated in
+// place, and moves |begin| to the line after it. The last line may
+// lack '\n', so *(*begin + *length) must be '\0'. Returns NULL at the
+// end of the buffer.
 char *getline(char **begin, int *length) {
+  if (*length <= 0) {
+    return 0;
+  }
   char *end = *begin + *length;
   char *n = std::find(*begin, end, '\n');
+  char *result = *begin;
   if (n != end) {
     *n = '\0';
+    *begin = n + 1;
+  } else {
+    *begin = end;
   }
-  *length -= static_cast<int>(n - *begin);
-  char *result = *begin;
-  *begin = n + 1;
+  *length = static_cast<int>(end - *begin);
   return result;
 }
 
-void make_csv_feature(const char **feature, size_t size,
-                      std::string *str) {
-  std::string tmp;
+typedef void (*string_writer_t)(const char *str, size_t length,
+                                StringBuffer *os);
+
+void write_raw_string(const char *str, size_t length, StringBuffer *os) {
+  os->write(str, length);
+}
+
+void write_xml_string(const char *str, size_t length, StringBuffer *os) {
+  const char *begin = str;
+  const char *end = str + length;
+  for (const char *p = str; p < end; ++p) {
+    const char *entity = 0;
+    switch (*p) {
+      case '\"': entity = "&quot;"; break;
+      case '\'': entity = "&apos;"; break;
+      case '<':  entity = "&lt;";   break;
+      case '>':  entity = "&gt;";   break;
+      case '&':  entity = "&amp;";  break;
+      default: continue;
+    }
+    os->write(begin, p - begin);
+    os->write(entity);
+    begin = p + 1;
+  }
+  os->write(begin, end - begin);
+}
+
+void write_xml_string(const char *str, StringBuffer *os) {
+  write_xml_string(str, std::strlen(str), os);
+}
+
+// Writes |feature| as CSV through |write|. Elements containing
+// ',' or '"' are quoted in the same way as escape_csv_element().
+void write_csv_feature(const char **feature, size_t size,
+                       StringBuffer *os, string_writer_t write) {
   for (size_t i = 0; i < size; ++i) {
-    tmp = feature[i] ? std::string(feature[i]) : "*";
-    escape_csv_element(&tmp);
     if (i != 0) {
-      *str += ',';
+      write(",", 1, os);
     }
-    *str += tmp;
+    const char *str = feature[i] ? feature[i] : "*";
+    const size_t length = std::strlen(str);
+    if (!std::strpbrk(str, ",\"")) {
+      write(str, length, os);
+      continue;
+    }
+    write("\"", 1, os);
+    const char *begin = str;
+    for (const char *p = str; *p; ++p) {
+      if (*p == '"') {
+        write(begin, p - begin + 1, os);
+        begin = p;  // emit the quote twice
+      }
+    }
+    write(begin, str + length - begin, os);
+    write("\"", 1, os);
   }
 }
 
@@ -110,10 +171,10 @@ void write_lattice(const Tree &tree, StringBuffer *os,
                 << chunk->head_pos << "/" << chunk->func_pos
                 << " " << chunk->score;
             if (chunk->feature_list) {
-              std::string str;
-              make_csv_feature(chunk->feature_list,
-                               chunk->feature_list_size, &str);
-              *os << ' ' << str;
+              *os << ' ';
+              write_csv_feature(chunk->feature_list,
+                                chunk->feature_list_size,
+                                os, &write_raw_string);
             }
             break;
           case OUTPUT_DEP:
@@ -130,20 +191,6 @@ void write_lattice(const Tree &tree, StringBuffer *os,
   }
 }
 
-void write_xml_string(const char *str, StringBuffer *os) {
-  while (*str) {
-    switch (*str) {
-      case '\"': *os << "&quot;"; break;
-      case '\'': *os << "&apos;"; break;
-      case '<': *os << "&lt;"; break;
-      case '>': *os << "&gt;"; break;
-      case '&': *os << "&amp;"; break;
-      default: *os << *str;
-    }
-    ++str;
-  }
-}
-
 void write_xml_token(const Token &token, StringBuffer *os, int i) {
   *os << "  <tok id=\"" << i << "\""
       << " feature=\"";
@@ -178,10 +225,9 @@ void write_xml(const Tree &tree, StringBuffer *os,
           << "\" head=\"" << chunk->head_pos + i
           << "\" func=\"" << chunk->func_pos + i << "\"";
       if (output_layer == OUTPUT_SELECTION && chunk->feature_list) {
-        std::string str;
-        make_csv_feature(chunk->feature_list, chunk->feature_list_size, &str);
         *os << " feature=\"";
-        write_xml_string(str.c_str(), os);
+        write_csv_feature(chunk->feature_list, chunk->feature_list_size,
+                          os, &write_xml_string);
         *os << "\"";
       }
       *os << ">\n";
@@ -195,90 +241,122 @@ void write_xml(const Tree &tree, StringBuffer *os,
   *os << "</sentence>\n";
 }
 
-void write_tree(const Tree &tree, StringBuffer *os,
-                int output_layer, int charset) {
-  const size_t size = tree.token_size();
-  bool in = false;
-  size_t max_len = 0;
-  std::string ne;
-  std::vector<std::pair<size_t, std::string> > chunks;
+void write_ne_tag(const char *ne, bool close, std::string *text) {
+  text->append(close ? "</" : "<");
+  text->append(ne);
+  text->append(1, '>');
+}
 
-  for (size_t i = 0; i < size;) {
-    size_t cid = i;
-    chunks.resize(chunks.size() + 1);
-    std::string surface;
-    for (; i < size; ++i) {
-      const Token *token = tree.token(i);
-      if (in && token->ne &&
-          (token->ne[0] == 'B' || token->ne[0] == 'O')) {
-        surface += "</";
-        surface += ne;
-        surface += ">";
-        in = false;
-      }
+// Appends the surfaces (with NE tags) of the chunk starting at token
+// |begin| to |text|. |ne| and |in| carry the open NE tag over chunk
+// boundaries. Returns the first token of the next chunk.
+size_t write_tree_chunk(const Tree &tree, size_t begin,
+                        const char **ne, bool *in, std::string *text) {
+  const size_t size = tree.token_size();
+  size_t i = begin;
+  for (; i < size; ++i) {
+    const Token *token = tree.token(i);
+    if (*in && token->ne &&
+        (token->ne[0] == 'B' || token->ne[0] == 'O')) {
+      write_ne_tag(*ne, true, text);
+      *in = false;
+    }
 
-      if (i != cid && token->chunk) {
-        break;
-      }
+    if (i != begin && token->chunk) {
+      break;
+    }
 
-      if (token->ne && token->ne[0] == 'B') {
-        ne = std::string(token->ne + 2);
-        surface += "<";
-        surface += ne;
-        surface += ">";
-        in = true;
-      }
+    if (token->ne && token->ne[0] == 'B') {
+      *ne = token->ne + 2;
+      write_ne_tag(*ne, false, text);
+      *in = true;
+    }
 
-      surface += std::string(token->surface);
+    text->append(token->surface);
 
-      if (in && i + 1 == size) {
-        surface += "</";
-        surface += ne;
-        surface += ">";
-      }
+    if (*in && i + 1 == size) {
+      write_ne_tag(*ne, true, text);
     }
-
-    max_len = std::max(static_cast<size_t>(max_len),
-                       get_string_length(surface, charset));
-    chunks.back() = std::make_pair(cid, surface);
   }
+  return i;
+}
 
-  std::vector<int> e(chunks.size(), 0);
+void write_tree(const Tree &tree, StringBuffer *os,
+                int output_layer, int charset) {
+  const size_t size = tree.token_size();
+  size_t max_len = 0;
+  bool in = false;
+  const char *ne = 0;
+
+  // first pass: text and display width of each chunk. The width is
+  // counted once over the text of the whole chunk, which is long
+  // enough for the block-wise UTF-8 counter.
+  TreeAllocator *allocator = tree.allocator();
+  std::vector<TreeLayout> &layout = allocator->layout;
+  std::string &text = allocator->tree_text;
+  layout.clear();
+  text.clear();
+  for (size_t i = 0; i < size;) {
+    TreeLayout chunk;
+    chunk.token = i;
+    chunk.begin = text.size();
+    i = write_tree_chunk(tree, i, &ne, &in, &text);
+    chunk.end = text.size();
+    chunk.width = get_string_length(text.data() + chunk.begin,
+                                    chunk.end - chunk.begin, charset);
+    chunk.bar = false;
+    max_len = std::max(max_len, chunk.width);
+    layout.push_back(chunk);
+  }
 
-  for (size_t i = 0; i < chunks.size(); ++i) {
+  // second pass: write the text and links
+  for (size_t ci = 0; ci < layout.size(); ++ci) {
     bool isdep = false;
-    const int  link = tree.token(chunks[i].first)->chunk->link;
-    const std::string &surface = chunks[i].second;
-    const size_t rem = max_len - get_string_length(surface, charset) + i * 2;
-    for (size_t j = 0; j < rem; ++j) {
-      *os << ' ';
-    }
-    *os << surface.c_str();
+    const Chunk *chunk = tree.token(layout[ci].token)->chunk;
+    const int link = chunk ? chunk->link : -1;
+    os->fill(' ', max_len - layout[ci].width + ci * 2);
+    os->write(text.data() + layout[ci].begin,
+              layout[ci].end - layout[ci].begin);
 
-    for (size_t j = i+1; j < chunks.size(); j++) {
+    for (size_t j = ci + 1; j < layout.size(); j++) {
       if (link == static_cast<int>(j)) {
-        *os << "-" << "D";
-        isdep = 1;
-        e[j] = 1;
-      } else if (e[j]) {
-        *os <<  " |";
+        *os << "-D";
+        isdep = true;
+        layout[j].bar = true;
+      } else if (layout[j].bar) {
+        *os << " |";
       } else if (isdep) {
         *os << "  ";
       } else {
         *os << "--";
       }
     }
-    *os << "\n";
+    *os << '\n';
   }
 
   *os << "EOS\n";
 }
 
+// Same as concat_feature(), but writes to |os| directly.
+void write_concat_feature(const Token *token, size_t size,
+                          StringBuffer *os) {
+  const size_t minsize = std::min(static_cast<size_t>(token->feature_list_size),
+                                  size);
+  for (size_t i = 0; i < minsize; ++i) {
+    if (std::strcmp("*", token->feature_list[i]) == 0) {
+      break;
+    }
+    if (i != 0) {
+      *os << '-';
+    }
+    *os << token->feature_list[i];
+  }
+}
+
 bool write_conll(const Tree &tree, StringBuffer *os,
                  int output_layer, int charset) {
   const size_t size = tree.chunk_size();
   int token_id = 1;
-  std::string pos;
 
   for (size_t i = 0; i < size; ++i) {
     const Chunk *chunk = tree.chunk(i);
@@ -300,13 +378,14 @@ bool write_conll(const Tree &tree, StringBuffer *os,
       const Token *token = tree.token(chunk->token_pos + j);
 
       const char *lemma = token->normalized_surface;
+      size_t pos_size = 0;
       if (tree.posset() == IPA || tree.posset() == UNIDIC) {
-        concat_feature(token, 4, &pos);
+        pos_size = 4;
         if (token->feature_list_size > 7) {
           lemma = token->feature_list[6];
         }
       } else if (tree.posset() == JUMAN) {
-        concat_feature(token, 2, &pos);
+        pos_size = 2;
         if (token->feature_list_size > 5) {
           lemma = token->feature_list[4];
         }
@@ -317,8 +396,9 @@ bool write_conll(const Tree &tree, StringBuffer *os,
       }
 
       *os << token_id++ << '\t' << token->surface << '\t' << lemma
-          << '\t' << category << '\t' << pos
-          << "\tfeature=" << token->feature;
+          << '\t' << category << '\t';
+      write_concat_feature(token, pos_size, os);
+      *os << "\tfeature=" << token->feature;
       if (j == 0 && output_layer >= OUTPUT_CHUNK) {
         *os << "|begin_chunk=1";
       }
@@ -337,6 +417,93 @@ bool write_conll(const Tree &tree, StringBuffer *os,
   return true;
 }
 
+// Normalizes the whole sentence in one pass and points
+// normalized_surface of each token into a single arena buffer.
+// The surfaces are used as they are when nothing changes.
+void normalize_tokens(Tree *tree, int charset) {
+  TreeAllocator *allocator = tree->allocator();
+  const size_t size = tree->token_size();
+  std::vector<size_t> &offset = allocator->offset;
+  offset.resize(size + 1);
+  offset[0] = 0;
+  for (size_t i = 0; i < size; ++i) {
+    offset[i + 1] = offset[i] + std::strlen(tree->token(i)->surface);
+  }
+
+  if (!Normalizer::normalize(charset, allocator->sentence.data(),
+                             &offset[0], size, &allocator->normalized)) {
+    return;
+  }
+
+  char *buf = tree->alloc(allocator->normalized.size());
+  std::memcpy(buf, allocator->normalized.data(),
+              allocator->normalized.size());
+  for (size_t i = 0; i < size; ++i) {
+    tree->mutable_token(i)->normalized_surface = buf + offset[i];
+  }
+}
+
+// The nodes were given by the lattice of this tree, which was parsed
+// without MECAB_ALLOCATE_SENTENCE. Their surfaces point into the
+// sentence, so the tree must not be cleared, and the features are
+// owned by the dictionary, which lives as long as the parser.
+// Only the surfaces are copied, into one buffer, as MeCab does not
+// terminate them.
+bool read_borrowed(Tree *tree, const mecab_node_t *node) {
+  TreeAllocator *allocator = tree->allocator();
+  allocator->token.clear();
+  allocator->chunk.clear();
+  if (!node) {
+    return false;
+  }
+
+  size_t size = 0;
+  for (const mecab_node_t *n = node; n; n = n->next) {
+    size += n->length + 1;
+  }
+  char *surface = tree->alloc(size);
+
+  const std::string &sentence = allocator->sentence;
+  const char *begin = sentence.data();
+  size_t length = 0;
+  bool contiguous = true;
+  char *cols[256];
+  for (; node; node = node->next) {
+    if (node->stat == MECAB_BOS_NODE || node->stat == MECAB_EOS_NODE) {
+      continue;
+    }
+    contiguous = contiguous && node->surface == begin + length;
+    length += node->length;
+    Token *token  = tree->add_token();
+    std::copy(node->surface, node->surface + node->length, surface);
+    surface[node->length] = '\0';
+    token->surface = surface;
+    token->normalized_surface = surface;
+    token->feature = node->feature;
+    token->chunk = 0;
+    token->ne = 0;
+    surface += node->length + 1;
+    char *tmp = tree->strdup(token->feature);
+    const size_t s = tokenizeCSV(tmp, cols, sizeof(cols));
+    char **feature = tree->alloc_char_array(s);
+    std::copy(cols, cols + s, feature);
+    token->feature_list = const_cast<const char **> (feature);
+    token->feature_list_size = s;
+  }
+
+  // The sentence holds the concatenated surfaces. It is rebuilt only
+  // when MeCab skipped white spaces.
+  if (!contiguous || length != sentence.size()) {
+    allocator->sentence.clear();
+    for (size_t i = 0; i < tree->token_size(); ++i) {
+      allocator->sentence.append(tree->token(i)->surface);
+    }
+  }
+
+  normalize_tokens(tree, tree->charset());
+  return true;
+}
+
 bool write_tree(const Tree &tree, StringBuffer *os,
                 int output_layer, int output_format, int charset) {
   os->clear();
@@ -452,11 +619,13 @@ TreeAllocator *Tree::allocator() const {
 }
 
 bool Tree::read(const mecab_node_t *node) {
+  if (tree_allocator_->borrow_mecab_node) {
+    return read_borrowed(this, node);
+  }
   clear();
   if (!node) {
     return false;
   }
-  std::string normalized;
   char *cols[256];
   for (; node; node = node->next) {
     if (node->stat == MECAB_BOS_NODE || node->stat == MECAB_EOS_NODE) {
@@ -467,11 +636,7 @@ bool Tree::read(const mecab_node_t *node) {
     std::copy(node->surface, node->surface + node->length, surface);
     surface[node->length] = '\0';
     token->surface = surface;
-    normalized.clear();
-    Normalizer::normalize(charset_,
-                          node->surface, node->length,
-                          &normalized);
-    token->normalized_surface = this->strdup(normalized.c_str());
+    token->normalized_surface = surface;
     token->feature = this->strdup(node->feature);
     token->chunk = 0;
     token->ne = 0;
@@ -483,6 +648,7 @@ bool Tree::read(const mecab_node_t *node) {
     token->feature_list = const_cast<const char **> (feature);
     token->feature_list_size = s;
   }
+  normalize_tokens(this, charset_);
   return true;
 }
 
@@ -514,15 +680,15 @@ bool Tree::read(const char *input, size_t length,
       Chunk *old_chunk = 0;
       char *column[8];
       char *cols[256];
-      std::string normalized;
 
       char *buf = this->alloc(length + 1);
-      std::strncpy(buf, input, length);
+      std::memcpy(buf, input, length);
+      buf[length] = '\0';
       int len = static_cast<int>(length);
 
       while (true) {
         char *line = getline(&buf, &len);
-        if (len <= 0) break;
+        if (!line) break;
         if (std::strlen(line) >= 3 && line[0] == '*' && line[1] == ' ') {
           const size_t size = tokenize(line, " ", column, sizeof(column));
           if (size >= 3 && (column[1][0] == '-' || isdigit(column[1][0]))) {
@@ -581,10 +747,7 @@ bool Tree::read(const char *input, size_t length,
             Token *token   = add_token();
             token->chunk   = chunk;
             token->surface = column[0];
-            Normalizer::normalize(charset_,
-                                  column[0], std::strlen(column[0]),
-                                  &normalized);
-            token->normalized_surface = this->strdup(normalized.c_str());
+            token->normalized_surface = column[0];
             token->feature = column[1];
             token->ne      = size >= 3 ? column[2] : 0;
             tree_allocator_->sentence.append(column[0]);
@@ -608,6 +771,8 @@ bool Tree::read(const char *input, size_t length,
       if (old_chunk && old_chunk->token_size == 0) {
         return false;
       }
+
+      normalize_tokens(this, charset_);
   }
 
   // verfy chunk link
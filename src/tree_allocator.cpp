@@ -9,10 +9,12 @@
 #include <iostream>
 #include "cabocha.h"
 #include "common.h"
+#include "crf.h"
 #include "dep.h"
 #include "freelist.h"
 #include "morph.h"
 #include "string_buffer.h"
+#include "token_cache.h"
 #include "tree_allocator.h"
 
 namespace CaboCha {
@@ -21,7 +23,12 @@ TreeAllocator::TreeAllocator()
     : mecab_lattice(0),
       crfpp_chunker(0),
       crfpp_ne(0),
+      crf_lattice(0),
       dependency_parser_data(0),
+      borrow_mecab_node(false),
+      ne_sentence_size(0),
+      ne_skip_size(0),
+      dep_classify_size(0),
       char_freelist_(BUF_SIZE * 16),
       token_freelist_(CABOCHA_TOKEN_SIZE),
       chunk_freelist_(CABOCHA_CHUNK_SIZE),
@@ -41,6 +48,8 @@ TreeAllocator::~TreeAllocator() {
     crfpp_destroy(crfpp_ne);
     crfpp_ne = 0;
   }
+  delete crf_lattice;
+  crf_lattice = 0;
   delete dependency_parser_data;
   dependency_parser_data = 0;
 }
@@ -53,6 +62,9 @@ void TreeAllocator::free() {
   if (os_.get()) {
     os_->clear();
   }
+  if (token_cache_.get() && token_cache_->full()) {
+    token_cache_->clear();
+  }
   if (mecab_lattice) {
     MorphAnalyzer::clearMeCabLattice(mecab_lattice);
   }
@@ -103,6 +115,13 @@ StringBuffer *TreeAllocator::mutable_string_buffer() {
   return os_.get();
 }
 
+TokenCache *TreeAllocator::mutable_token_cache() {
+  if (!token_cache_.get()) {
+    token_cache_.reset(new TokenCache(CABOCHA_TOKEN_CACHE_SIZE));
+  }
+  return token_cache_.get();
+}
+
 std::ostream *TreeAllocator::stream() const {
   return stream_;
 }
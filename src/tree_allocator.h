@@ -14,6 +14,7 @@
 #include "morph.h"
 #include "scoped_ptr.h"
 #include "string_buffer.h"
+#include "token_cache.h"
 
 struct mecab_lattice_t;
 struct crfpp_t;
@@ -21,6 +22,17 @@ struct crfpp_t;
 namespace CaboCha {
 
 class StringBuffer;
+
+// A chunk of the tree format. The surfaces and NE tags of the chunk
+// are tree_text[begin, end) of TreeAllocator.
+struct TreeLayout {
+  size_t token;  // first token of the chunk
+  size_t begin;
+  size_t end;
+  size_t width;  // display width of the text
+  bool   bar;    // a link from the left passes through this column
+};
+struct CRFLattice;
 struct DependencyParserData;
 
 class TreeAllocator {
@@ -29,12 +41,28 @@ class TreeAllocator {
   std::vector<const Chunk *>  chunk;
   std::string                 sentence;
   std::vector<const char *>   feature;
+  // scratch areas reused across sentences
+  std::vector<TreeLayout>     layout;           // tree writer
+  std::string                 tree_text;        // tree writer
+  std::vector<size_t>         offset;           // sentence normalizer
+  std::string                 normalized;
 
   mecab_lattice_t      *mecab_lattice;
   crfpp_t              *crfpp_chunker;
   crfpp_t              *crfpp_ne;
+  CRFLattice           *crf_lattice;
   DependencyParserData *dependency_parser_data;
 
+  // When true, MeCab parses the sentence in place and the tokens
+  // point to the features in its dictionary. Only for a tree which
+  // does not outlive the parser.
+  bool borrow_mecab_node;
+
+  // profiling counters
+  size_t ne_sentence_size;  // sentences given to the NE tagger
+  size_t ne_skip_size;      // sentences skipped by the NE pre-filter
+  size_t dep_classify_size; // classify() calls of the dependency parser
+
   TreeAllocator();
   virtual ~TreeAllocator();
 
@@ -47,6 +75,7 @@ class TreeAllocator {
   Chunk* allocChunk();
   Token* allocToken();
   StringBuffer *mutable_string_buffer();
+  TokenCache *mutable_token_cache();
 
   std::ostream *stream() const;
   void set_stream(std::ostream *os);
@@ -60,6 +89,7 @@ class TreeAllocator {
   FreeList<Chunk>           chunk_freelist_;
   FreeList<char *>          char_array_freelist_;
   scoped_ptr<StringBuffer>  os_;
+  scoped_ptr<TokenCache>    token_cache_;
   std::ostream             *stream_;
   whatlog                   what_;
 };
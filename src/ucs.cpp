@@ -25,6 +25,19 @@
 
 #include "ucs.h"
 
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__)) && \
+  GCC_VERSION >= 40900
+#define CABOCHA_UTF8_SSE2
+#define CABOCHA_TARGET_SSE2 __attribute__((target("sse2")))
+#elif defined(_M_X64)
+#define CABOCHA_UTF8_SSE2
+#define CABOCHA_TARGET_SSE2
+#endif
+
+#ifdef CABOCHA_UTF8_SSE2
+#include <emmintrin.h>
+#endif
+
 namespace CaboCha {
 namespace {
 
@@ -50,6 +63,122 @@ DWORD decode_charset_win32(const char *str) {
 const char *decode_charset_iconv(const char *str) {
   return CaboCha::encode_charset(CaboCha::decode_charset(str));
 }
+
+// length of the character at |begin|, as utf8_to_ucs2() reads it
+inline size_t utf8_mblen(const char *begin, const char *end) {
+  const size_t len = end - begin;
+  const unsigned char c = static_cast<unsigned char>(begin[0]);
+  if (c < 0x80) return 1;
+  if (len >= 2 && (c & 0xe0) == 0xc0) return 2;
+  if (len >= 3 && (c & 0xf0) == 0xe0) return 3;
+  if (len >= 4 && (c & 0xf8) == 0xf0) return 4;
+  if (len >= 5 && (c & 0xfc) == 0xf8) return 5;
+  if (len >= 6 && (c & 0xfe) == 0xfc) return 6;
+  return 1;
+}
+
+// |single| and |multi| count the characters of one byte and of more
+// bytes, and the return value is where the counting stopped.
+typedef const char *(*utf8_count_t)(const char *begin, const char *end,
+                                    size_t *single, size_t *multi);
+
+const char *utf8_count_scalar(const char *begin, const char *end,
+                              size_t *single, size_t *multi) {
+  while (begin < end) {
+    const size_t mblen = utf8_mblen(begin, end);
+    if (mblen == 1) {
+      ++*single;
+    } else {
+      ++*multi;
+    }
+    begin += mblen;
+  }
+  return begin;
+}
+
+#ifdef CABOCHA_UTF8_SSE2
+inline unsigned int popcount16(unsigned int x) {
+  x = x - ((x >> 1) & 0x5555);
+  x = (x & 0x3333) + ((x >> 2) & 0x3333);
+  x = (x + (x >> 4)) & 0x0f0f;
+  return (x + (x >> 8)) & 0x1f;
+}
+
+// Counts 16 bytes at a time. The bytes of a block are classified
+// into ASCII, 2- and 3-byte leads and continuations; when every
+// continuation is exactly where a lead expects one, stepping
+// through the block gives the same characters as the scalar loop,
+// so they are counted from the masks. A character running over the
+// block is left to the next block, and anything else (4-byte or
+// broken sequences) is stepped over by one character.
+CABOCHA_TARGET_SSE2
+const char *utf8_count_sse2(const char *begin, const char *end,
+                            size_t *single, size_t *multi) {
+  const __m128i c0 = _mm_set1_epi8(static_cast<char>(0xbf));
+  const __m128i e0 = _mm_set1_epi8(static_cast<char>(0xdf));
+  const __m128i f0 = _mm_set1_epi8(static_cast<char>(0xef));
+  while (end - begin >= 16) {
+    const __m128i v =
+        _mm_loadu_si128(reinterpret_cast<const __m128i *>(begin));
+    const unsigned int hi = _mm_movemask_epi8(v);
+    if (hi == 0) {
+      *single += 16;
+      begin += 16;
+      continue;
+    }
+    // as signed bytes, 0x80-0xbf < 0xc0-0xdf < 0xe0-0xef < 0xf0-0xff
+    const unsigned int ge_c0 =
+        _mm_movemask_epi8(_mm_cmpgt_epi8(v, c0)) & hi;
+    const unsigned int ge_e0 =
+        _mm_movemask_epi8(_mm_cmpgt_epi8(v, e0)) & hi;
+    const unsigned int ge_f0 =
+        _mm_movemask_epi8(_mm_cmpgt_epi8(v, f0)) & hi;
+    const unsigned int cont = hi & ~ge_c0;
+    const unsigned int lead2 = ge_c0 & ~ge_e0;
+    const unsigned int lead3 = ge_e0;
+
+    unsigned int limit = 16;
+    if (lead3 & 0x4000) {
+      limit = 14;
+    } else if ((lead2 | lead3) & 0x8000) {
+      limit = 15;
+    }
+    const unsigned int mask = (1U << limit) - 1;
+    const unsigned int expected =
+        ((lead2 & mask) << 1) | ((lead3 & mask) << 1) | ((lead3 & mask) << 2);
+    if (ge_f0 || expected != (cont & mask)) {
+      const size_t mblen = utf8_mblen(begin, end);
+      if (mblen == 1) {
+        ++*single;
+      } else {
+        ++*multi;
+      }
+      begin += mblen;
+      continue;
+    }
+    *single += popcount16(~hi & mask);
+    *multi += popcount16((lead2 | lead3) & mask);
+    begin += limit;
+  }
+  return begin;
+}
+
+utf8_count_t select_utf8_count() {
+#if defined(__GNUC__)
+  __builtin_cpu_init();
+  if (!__builtin_cpu_supports("sse2")) {
+    return &utf8_count_scalar;
+  }
+#endif
+  return &utf8_count_sse2;
+}
+#else
+utf8_count_t select_utf8_count() {
+  return &utf8_count_scalar;
+}
+#endif
+
+const utf8_count_t utf8_count_impl = select_utf8_count();
 }
 
 // All internal codes are represented in UCS2,
@@ -92,6 +221,15 @@ unsigned short utf8_to_ucs2(const char *begin,
   }
 }
 
+size_t utf8_count(const char *begin, const char *end, size_t *width) {
+  size_t single = 0;
+  size_t multi = 0;
+  begin = (*utf8_count_impl)(begin, end, &single, &multi);
+  utf8_count_scalar(begin, end, &single, &multi);
+  *width = single + 2 * multi;
+  return single + multi;
+}
+
 unsigned short ascii_to_ucs2(const char *begin, const char *end,
                              size_t *mblen) {
   *mblen = 1;
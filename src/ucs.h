@@ -25,6 +25,13 @@ unsigned short utf8_to_ucs2(const char *begin,
                             const char *end,
                             size_t *mblen);
 
+// Steps through the UTF-8 string [begin, end) in the same way as
+// utf8_to_ucs2() and returns the number of characters. |width|
+// receives the display width: one column for a single byte
+// character, two for the others. Runs of well-formed text are
+// counted 16 bytes at a time where the CPU supports SSE2.
+size_t utf8_count(const char *begin, const char *end, size_t *width);
+
 unsigned short ascii_to_ucs2(const char *begin,
                              const char *end,
                              size_t *mblen);
@@ -11,6 +11,11 @@
 #include <unistd.h>
 #endif
 
+#if defined(_WIN32) && !defined(__CYGWIN__)
+#include <io.h>
+#endif
+
+#include <cstdio>
 #include <iostream>
 #include <fstream>
 #include <cstring>
@@ -204,15 +209,15 @@ bool read_sentence(std::istream *is, std::string *str,
   if (inputLayer == INPUT_RAW_SENTENCE) {
     std::getline(*is, *str);
   } else {
-    scoped_fixed_array<char, BUF_SIZE * 16> line;
+    std::string line;
     size_t line_num = 0;
-    while (is->getline(line.get(), line.size())) {
-      str->append(line.get());
+    while (std::getline(*is, line)) {
+      str->append(line);
       *str += '\n';
       if (++line_num > CABOCHA_MAX_LINE_SIZE) {
         return false;
       }
-      if (std::strlen(line.get()) == 0 || strcmp(line.get(), "EOS") == 0) {
+      if (line.empty() || line == "EOS") {
         break;
       }
     }
@@ -279,14 +284,14 @@ int progress_bar(const char* message, size_t current, size_t total) {
   int cur_percentage  = static_cast<int> (100.0 * current/total);
   int bar_len = static_cast<int> (1.0 * current*scale/total);
 
+  // written to std::cout, so that the progress goes wherever the
+  // rest of the output of the learners goes.
   if (prev != cur_percentage) {
-    printf("%s: %3d%% |%.*s%*s| ",
-           message, cur_percentage, bar_len, bar, scale - bar_len, "");
-    if (cur_percentage == 100)
-      printf("\n");
-    else
-      printf("\r");
-    fflush(stdout);
+    char buf[256];
+    snprintf(buf, sizeof(buf), "%s: %3d%% |%.*s%*s| ",
+             message, cur_percentage, bar_len, bar, scale - bar_len, "");
+    std::cout << buf << (cur_percentage == 100 ? '\n' : '\r')
+              << std::flush;
   }
 
   prev = cur_percentage;
@@ -301,4 +306,14 @@ void Unlink(const char *filename) {
   ::unlink(filename);
 #endif
 }
+
+bool is_stdout_terminal() {
+#if defined(_WIN32) && !defined(__CYGWIN__)
+  return ::_isatty(::_fileno(stdout)) != 0;
+#elif defined(HAVE_UNISTD_H)
+  return ::isatty(::fileno(stdout)) != 0;
+#else
+  return false;
+#endif
+}
 }
@@ -211,6 +211,7 @@ inline char getEscapedChar(const char p) {
 }
 
 void Unlink(const char *filename);
+bool is_stdout_terminal();
 
 #if defined(_WIN32) && !defined(__CYGWIN__)
 std::wstring Utf8ToWide(const std::string &input);